@@ -5,6 +5,9 @@
 #include "point.hpp"
 #include "line.hpp"
 #include "plane.hpp"
+#include "profiler.hpp"
+#include <future>
+#include <thread>
 #include <vector>
 
 class BSPNode {
@@ -22,6 +25,13 @@ public:
     }
 
     void insert(const Polygon& polygon);
+    BSPNode* makeChild(const Plane& plane, const Polygon& polygon);
+
+    BSPNode* clone() const;
+    void invert();
+    std::vector<Polygon> clipPolygons(const std::vector<Polygon>& polygons) const;
+    void clipTo(const BSPNode* other, size_t parallelDepth);
+    void collectPolygons(std::vector<Polygon>& out) const;
 
     const Polygon* detectCollision(const LineSegment& traceLine) const;
     
@@ -41,18 +51,51 @@ class BSPTree {
 private:
     BSPNode* root;
 
+    void invert() {
+        if (root) {
+            root->invert();
+        }
+    }
+    void clipTo(const BSPTree& other, size_t parallelDepth) {
+        if (root && other.root) {
+            root->clipTo(other.root, parallelDepth);
+        }
+    }
+
+    static size_t defaultParallelDepth();
+
 public:
     BSPTree() : root(nullptr) {}
+    BSPTree(const BSPTree& other) : root(other.root ? other.root->clone() : nullptr) {}
+    BSPTree(BSPTree&& other) noexcept : root(other.root) {
+        other.root = nullptr;
+    }
     ~BSPTree() {
         delete root;
     }
 
+    BSPTree& operator=(BSPTree other) {
+        std::swap(root, other.root);
+        return *this;
+    }
+
     BSPNode* getRoot() const { return root; }
     bool isEmpty() const { return root == nullptr; }
 
     void insert(const Polygon& polygon);
+    void insert(const std::vector<Polygon>& polygons);
+
+    std::vector<Polygon> getPolygons() const;
+
+    // Boolean operations treat each tree as a closed solid whose polygons face outwards
+    BSPTree unite(const BSPTree& other, size_t parallelDepth = defaultParallelDepth()) const;
+    BSPTree intersect(const BSPTree& other, size_t parallelDepth = defaultParallelDepth()) const;
+    BSPTree subtract(const BSPTree& other, size_t parallelDepth = defaultParallelDepth()) const;
+    bool isInside(const Point3D& point) const;
 
     const Polygon* detectCollision(const LineSegment& line) const {
+        BSP_PROFILE_SCOPE(TRAVERSE);
+
         if (root == nullptr) {
             return nullptr;
         }
@@ -76,52 +119,203 @@ void BSPNode::insert(const Polygon& polygon) {
 
     if(relation == RelationType::IN_FRONT) {
         if (front == nullptr) {
-            front = new BSPNode(plane);
-            front->parent = this;
-            front->polygons.push_back(polygon);
+            front = makeChild(plane, polygon);
         } else {
             front->insert(polygon);
         }
     } else if(relation == RelationType::BEHIND) {
         if (back == nullptr) {
-            back = new BSPNode(plane);
-            back->parent = this;
-            back->polygons.push_back(polygon);
+            back = makeChild(plane, polygon);
         } else {
             back->insert(polygon);
         }
     } else if(relation == RelationType::COINCIDENT) {
         polygons.push_back(polygon);
     } else if(relation == RelationType::SPANNING) {
-        auto [frontPoly, backPoly] = polygon.split(plane);
+        auto [frontPoly, backPoly] = polygon.split(partition);
 
-        if (front == nullptr) {
-            front = new BSPNode(plane);
-            front->parent = this;
-            front ->polygons.push_back(frontPoly);
-        } else {
-            front->insert(frontPoly);
+        // A polygon barely crossing the partition leaves a sliver on one side
+        if (!frontPoly.isDegenerate()) {
+            if (front == nullptr) {
+                front = makeChild(plane, frontPoly);
+            } else {
+                front->insert(frontPoly);
+            }
         }
 
-        if (back == nullptr) {
-            back = new BSPNode(plane);
-            back->parent = this;
-            back->polygons.push_back(backPoly);
-        } else {
-            back->insert(backPoly);
+        if (!backPoly.isDegenerate()) {
+            if (back == nullptr) {
+                back = makeChild(plane, backPoly);
+            } else {
+                back->insert(backPoly);
+            }
         }
     } else {
         throw std::runtime_error("Invalid relation type");
     }
 }
 
+BSPNode* BSPNode::makeChild(const Plane& plane, const Polygon& polygon) {
+    BSP_PROFILE_SCOPE(ALLOCATE);
+
+    BSPNode* child = new BSPNode(plane);
+    child->parent = this;
+    child->polygons.push_back(polygon);
+    return child;
+}
+
+BSPNode* BSPNode::clone() const {
+    BSPNode* node = new BSPNode(partition);
+    node->polygons = polygons;
+
+    if (front) {
+        node->front = front->clone();
+        node->front->parent = node;
+    }
+    if (back) {
+        node->back = back->clone();
+        node->back->parent = node;
+    }
+    return node;
+}
+
+void BSPNode::invert() {
+    for (auto& polygon : polygons) {
+        polygon.flip();
+    }
+    partition = Plane(partition.getPoint(), -partition.getNormal());
+
+    if (front) {
+        front->invert();
+    }
+    if (back) {
+        back->invert();
+    }
+    std::swap(front, back);
+}
+
+// Removes the parts of the polygons that lie in the solid space of this subtree
+std::vector<Polygon> BSPNode::clipPolygons(const std::vector<Polygon>& polygons) const {
+    std::vector<Polygon> frontPolygons;
+    std::vector<Polygon> backPolygons;
+
+    for (const auto& polygon : polygons) {
+        RelationType relation = polygon.relationWithPlane(partition);
+
+        if (relation == RelationType::IN_FRONT) {
+            frontPolygons.push_back(polygon);
+        } else if (relation == RelationType::BEHIND) {
+            backPolygons.push_back(polygon);
+        } else if (relation == RelationType::COINCIDENT) {
+            if (partition.getNormal().dotProduct(polygon.computePlane().getNormal()) > NType(0)) {
+                frontPolygons.push_back(polygon);
+            } else {
+                backPolygons.push_back(polygon);
+            }
+        } else if (relation == RelationType::SPANNING) {
+            auto [frontPoly, backPoly] = polygon.split(partition);
+            if (!frontPoly.isDegenerate()) {
+                frontPolygons.push_back(frontPoly);
+            }
+            if (!backPoly.isDegenerate()) {
+                backPolygons.push_back(backPoly);
+            }
+        } else {
+            throw std::runtime_error("Invalid relation type");
+        }
+    }
+
+    if (front) {
+        frontPolygons = front->clipPolygons(frontPolygons);
+    }
+    if (back) {
+        backPolygons = back->clipPolygons(backPolygons);
+        frontPolygons.insert(frontPolygons.end(), backPolygons.begin(), backPolygons.end());
+    }
+    return frontPolygons;
+}
+
+// Front and back subtrees own disjoint polygons, so they are clipped concurrently
+// until parallelDepth levels have been split off
+void BSPNode::clipTo(const BSPNode* other, size_t parallelDepth) {
+    polygons = other->clipPolygons(polygons);
+
+    if (front && back && parallelDepth > 0) {
+        auto task = std::async(std::launch::async, [this, other, parallelDepth]() {
+            front->clipTo(other, parallelDepth - 1);
+        });
+        back->clipTo(other, parallelDepth - 1);
+        task.get();
+        return;
+    }
+
+    if (front) {
+        front->clipTo(other, parallelDepth);
+    }
+    if (back) {
+        back->clipTo(other, parallelDepth);
+    }
+}
+
+void BSPNode::collectPolygons(std::vector<Polygon>& out) const {
+    out.insert(out.end(), polygons.begin(), polygons.end());
+
+    if (front) {
+        front->collectPolygons(out);
+    }
+    if (back) {
+        back->collectPolygons(out);
+    }
+}
+
+// Returns the first polygon hit walking from P1 to P2, checking the near side
+// of each partition before the polygons on it and the far side last
 const Polygon* BSPNode::detectCollision(const LineSegment& traceLine) const {
-    
+    NType startDistance = partition.dist2Point(traceLine.getP1());
+    NType endDistance = partition.dist2Point(traceLine.getP2());
+
+    if (startDistance > NType(0) && endDistance > NType(0)) {
+        return front ? front->detectCollision(traceLine) : nullptr;
+    }
+    if (startDistance < NType(0) && endDistance < NType(0)) {
+        return back ? back->detectCollision(traceLine) : nullptr;
+    }
+
+    const BSPNode* nearNode = startDistance < NType(0) ? back : front;
+    const BSPNode* farNode = startDistance < NType(0) ? front : back;
+
+    if (nearNode) {
+        if (const Polygon* hit = nearNode->detectCollision(traceLine)) {
+            return hit;
+        }
+    }
+
+    // A segment lying on the partition only grazes its polygons
+    if (startDistance != endDistance) {
+        Vector3D direction(traceLine.getP2() - traceLine.getP1());
+        Point3D point = traceLine.getP1() + direction * (startDistance / (startDistance - endDistance));
+
+        for (const auto& polygon : polygons) {
+            if (polygon.contains(point)) {
+                return &polygon;
+            }
+        }
+    }
+
+    return farNode ? farNode->detectCollision(traceLine) : nullptr;
 }
 
 // BSPTree
 void BSPTree::insert(const Polygon& polygon) {
+    BSP_PROFILE_SCOPE(INSERT);
+
+    if (polygon.isDegenerate()) {
+        return;
+    }
+
     if (root == nullptr) {
+        BSP_PROFILE_SCOPE(ALLOCATE);
+
         root = new BSPNode(polygon.computePlane());
         root->polygons.push_back(polygon);
     } else {
@@ -129,4 +323,105 @@ void BSPTree::insert(const Polygon& polygon) {
     }
 }
 
+void BSPTree::insert(const std::vector<Polygon>& polygons) {
+    for (const auto& polygon : polygons) {
+        insert(polygon);
+    }
+}
+
+std::vector<Polygon> BSPTree::getPolygons() const {
+    std::vector<Polygon> polygons;
+    if (root) {
+        root->collectPolygons(polygons);
+    }
+    return polygons;
+}
+
+// An empty tree is empty space. The clipping sequences below skip a missing
+// operand entirely, so these cases are answered up front.
+BSPTree BSPTree::unite(const BSPTree& other, size_t parallelDepth) const {
+    if (isEmpty()) {
+        return other;
+    }
+    if (other.isEmpty()) {
+        return *this;
+    }
+
+    BSPTree a(*this);
+    BSPTree b(other);
+
+    a.clipTo(b, parallelDepth);
+    b.clipTo(a, parallelDepth);
+    b.invert();
+    b.clipTo(a, parallelDepth);
+    b.invert();
+    a.insert(b.getPolygons());
+
+    return a;
+}
+
+BSPTree BSPTree::intersect(const BSPTree& other, size_t parallelDepth) const {
+    if (isEmpty() || other.isEmpty()) {
+        return BSPTree();
+    }
+
+    BSPTree a(*this);
+    BSPTree b(other);
+
+    a.invert();
+    b.clipTo(a, parallelDepth);
+    b.invert();
+    a.clipTo(b, parallelDepth);
+    b.clipTo(a, parallelDepth);
+    a.insert(b.getPolygons());
+    a.invert();
+
+    return a;
+}
+
+BSPTree BSPTree::subtract(const BSPTree& other, size_t parallelDepth) const {
+    if (isEmpty() || other.isEmpty()) {
+        return *this;
+    }
+
+    BSPTree a(*this);
+    BSPTree b(other);
+
+    a.invert();
+    a.clipTo(b, parallelDepth);
+    b.clipTo(a, parallelDepth);
+    b.invert();
+    b.clipTo(a, parallelDepth);
+    b.invert();
+    a.insert(b.getPolygons());
+    a.invert();
+
+    return a;
+}
+
+// Follows the solid-leaf convention: falling off the back of a node is solid,
+// falling off the front is empty space. Points on a partition go to the front.
+bool BSPTree::isInside(const Point3D& point) const {
+    const BSPNode* node = root;
+    while (node != nullptr) {
+        if (node->partition.dist2Point(point) < NType(0)) {
+            if (node->back == nullptr) {
+                return true;
+            }
+            node = node->back;
+        } else {
+            node = node->front;
+        }
+    }
+    return false;
+}
+
+size_t BSPTree::defaultParallelDepth() {
+    size_t depth = 0;
+    for (size_t threads = std::thread::hardware_concurrency(); threads > 1; threads /= 2) {
+        ++depth;
+    }
+    return depth;
+}
+
 #endif // BSP_HPP
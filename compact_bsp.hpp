@@ -0,0 +1,476 @@
+#ifndef COMPACT_BSP_HPP
+#define COMPACT_BSP_HPP
+
+#include "data_type.hpp"
+#include "point.hpp"
+#include "line.hpp"
+#include "plane.hpp"
+#include "bsp_tree.hpp"
+#include "profiler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+template <unsigned Bits>
+struct QuantizedVertex;
+
+template <>
+struct QuantizedVertex<16> {
+    uint16_t axes[3];
+
+    uint32_t get(int axis) const { return axes[axis]; }
+    void set(int axis, uint32_t value) { axes[axis] = static_cast<uint16_t>(value); }
+};
+
+template <>
+struct QuantizedVertex<21> {
+    uint64_t packed;
+
+    uint32_t get(int axis) const { return static_cast<uint32_t>((packed >> (21 * axis)) & 0x1FFFFF); }
+    void set(int axis, uint32_t value) {
+        packed &= ~(uint64_t(0x1FFFFF) << (21 * axis));
+        packed |= uint64_t(value & 0x1FFFFF) << (21 * axis);
+    }
+};
+
+// Polygon and vertex runs end where the next node's and polygon's begin. Nodes
+// are stored in preorder, so a front child always directly follows its parent.
+struct CompactNode {
+    uint32_t normal; // Octahedral encoding, 16 bits per component
+    float distance;
+    uint32_t children; // High bit: has a front child; low 31 bits: back child
+    uint32_t firstPolygon;
+    uint8_t bounds[6]; // Node's vertex bounds, quantized against the scene bounds
+};
+
+// Read-only, flattened copy of a BSPTree. Plane tests widen by the worst-case
+// encoding error, so classification may report COINCIDENT where the original
+// tree would not, but never picks a side the original tree would not.
+//
+// A node costs 24 bytes, plus 4 per polygon and 6 (16-bit) or 8 (21-bit) per
+// vertex. Against the object bytes of a BSPNode holding one triangle or quad
+// (132 or 144) that is about 2.8x smaller with 16 bits and 2.4x with 21 bits;
+// counting allocator overhead of the three heap blocks behind each original node
+// it is about 3.5x. Larger polygons tend towards the ratio of the vertex sizes.
+template <unsigned Bits = 16>
+class CompactBSPTree {
+    static_assert(Bits == 16 || Bits == 21, "Vertices must be quantized to 16 or 21 bits");
+
+private:
+    std::vector<CompactNode> nodes;
+    std::vector<uint32_t> polygons; // First vertex of each polygon
+    std::vector<QuantizedVertex<Bits>> vertices;
+
+    float origin[3];
+    float step[3];
+    float center[3];
+    float radius;
+    float normalError;
+    float epsilon;
+
+    static constexpr uint32_t MAX_QUANTIZED = (1u << Bits) - 1;
+    static constexpr uint32_t HAS_FRONT = 1u << 31;
+    static constexpr uint32_t NO_BACK = HAS_FRONT - 1;
+
+    uint32_t flatten(const BSPNode* node);
+    void frame(const CompactNode& node, float nodeOrigin[3], float nodeStep[3]) const;
+    uint32_t polygonsEnd(uint32_t node) const;
+    uint32_t verticesEnd(uint32_t polygon) const;
+    float slack(const float point[3]) const;
+    float signedDistance(const CompactNode& node, const float point[3]) const;
+    bool overlaps(uint32_t node, uint32_t polygon, const float min[3], const float max[3]) const;
+    void collisionCandidates(uint32_t node, const float p1[3], const float p2[3],
+                             const float min[3], const float max[3], std::vector<uint32_t>& out) const;
+
+    static void bounds(const BSPNode* node, float min[3], float max[3]);
+    static uint32_t encodeNormal(const float normal[3]);
+    static void decodeNormal(uint32_t encoded, float normal[3]);
+
+public:
+    static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+    explicit CompactBSPTree(const BSPTree& tree);
+
+    uint32_t getRoot() const { return nodes.empty() ? NONE : 0; }
+    const CompactNode& getNode(uint32_t node) const { return nodes.at(node); }
+    uint32_t getFront(uint32_t node) const { return nodes.at(node).children & HAS_FRONT ? node + 1 : NONE; }
+    uint32_t getBack(uint32_t node) const {
+        uint32_t back = nodes.at(node).children & NO_BACK;
+        return back == NO_BACK ? NONE : back;
+    }
+    size_t getNodeCount() const { return nodes.size(); }
+    size_t getPolygonsCount() const { return polygons.size(); }
+    size_t memoryUsage() const;
+
+    Plane getPartition(uint32_t node) const;
+    Polygon getPolygon(uint32_t polygon) const;
+
+    RelationType classify(const Point3D& point, uint32_t node) const;
+    std::vector<uint32_t> collisionCandidates(const LineSegment& segment) const;
+};
+
+// CompactBSPTree
+template <unsigned Bits>
+CompactBSPTree<Bits>::CompactBSPTree(const BSPTree& tree)
+    : origin{0, 0, 0}, step{0, 0, 0}, center{0, 0, 0}, radius(0), normalError(0), epsilon(0) {
+    if (tree.isEmpty()) {
+        return;
+    }
+
+    float min[3] = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+    float max[3] = {std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()};
+    bounds(tree.getRoot(), min, max);
+
+    float magnitude = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        if (min[axis] > max[axis]) {
+            min[axis] = max[axis] = 0;
+        }
+        origin[axis] = min[axis];
+        step[axis] = (max[axis] - min[axis]) / std::numeric_limits<uint8_t>::max();
+        center[axis] = (min[axis] + max[axis]) / 2;
+        radius += (max[axis] - min[axis]) * (max[axis] - min[axis]) / 4;
+        magnitude = std::max(magnitude, std::max(std::abs(min[axis]), std::abs(max[axis])));
+    }
+    radius = std::sqrt(radius);
+
+    // Covers the Safe<float> comparison epsilon plus float rounding of the distances
+    epsilon = 1e-4f + magnitude * 1e-6f;
+
+    flatten(tree.getRoot());
+
+    nodes.shrink_to_fit();
+    polygons.shrink_to_fit();
+    vertices.shrink_to_fit();
+}
+
+template <unsigned Bits>
+uint32_t CompactBSPTree<Bits>::flatten(const BSPNode* node) {
+    if (nodes.size() >= NO_BACK || polygons.size() + node->polygons.size() >= NONE) {
+        throw std::length_error("Tree is too large for 32-bit indices");
+    }
+
+    // Octahedral encoding cannot represent a zero normal
+    Vector3D normal = node->partition.getNormal();
+    if (normal.mag() == NType(0)) {
+        throw std::invalid_argument("Partition has a degenerate normal");
+    }
+    normal = normal.unit();
+
+    uint32_t index = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(CompactNode());
+
+    Point3D point = node->partition.getPoint();
+    float n[3] = {normal.getX().getValue(), normal.getY().getValue(), normal.getZ().getValue()};
+    float p[3] = {point.getX().getValue(), point.getY().getValue(), point.getZ().getValue()};
+
+    CompactNode compact;
+    compact.normal = encodeNormal(n);
+
+    float decoded[3];
+    decodeNormal(compact.normal, decoded);
+    compact.distance = decoded[0] * p[0] + decoded[1] * p[1] + decoded[2] * p[2];
+    normalError = std::max(normalError, std::sqrt(
+        (n[0] - decoded[0]) * (n[0] - decoded[0]) +
+        (n[1] - decoded[1]) * (n[1] - decoded[1]) +
+        (n[2] - decoded[2]) * (n[2] - decoded[2])));
+
+    float nodeMin[3] = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+    float nodeMax[3] = {std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()};
+    for (const auto& polygon : node->polygons) {
+        for (const auto& vertex : polygon.getVertices()) {
+            float v[3] = {vertex.getX().getValue(), vertex.getY().getValue(), vertex.getZ().getValue()};
+            for (int axis = 0; axis < 3; ++axis) {
+                nodeMin[axis] = std::min(nodeMin[axis], v[axis]);
+                nodeMax[axis] = std::max(nodeMax[axis], v[axis]);
+            }
+        }
+    }
+
+    // Rounded outwards, so the decoded bounds always enclose the node's vertices
+    const float limit = std::numeric_limits<uint8_t>::max();
+    for (int axis = 0; axis < 3; ++axis) {
+        float low = 0;
+        float high = 0;
+        if (nodeMin[axis] <= nodeMax[axis] && step[axis] > 0) {
+            low = std::floor((nodeMin[axis] - origin[axis]) / step[axis]);
+            high = std::ceil((nodeMax[axis] - origin[axis]) / step[axis]);
+        }
+        compact.bounds[axis] = static_cast<uint8_t>(std::clamp(low, 0.0f, limit));
+        compact.bounds[axis + 3] = static_cast<uint8_t>(std::clamp(high, 0.0f, limit));
+    }
+
+    float nodeOrigin[3], nodeStep[3];
+    frame(compact, nodeOrigin, nodeStep);
+
+    compact.firstPolygon = static_cast<uint32_t>(polygons.size());
+    for (const auto& polygon : node->polygons) {
+        polygons.push_back(static_cast<uint32_t>(vertices.size()));
+
+        for (const auto& vertex : polygon.getVertices()) {
+            float v[3] = {vertex.getX().getValue(), vertex.getY().getValue(), vertex.getZ().getValue()};
+            QuantizedVertex<Bits> quantized = {};
+            for (int axis = 0; axis < 3; ++axis) {
+                float value = nodeStep[axis] > 0 ? std::round((v[axis] - nodeOrigin[axis]) / nodeStep[axis]) : 0;
+                quantized.set(axis, static_cast<uint32_t>(std::clamp(value, 0.0f, static_cast<float>(MAX_QUANTIZED))));
+            }
+            vertices.push_back(quantized);
+        }
+    }
+
+    compact.children = NO_BACK;
+    if (node->front) {
+        flatten(node->front);
+        compact.children |= HAS_FRONT;
+    }
+    if (node->back) {
+        compact.children = (compact.children & HAS_FRONT) | flatten(node->back);
+    }
+    nodes[index] = compact;
+
+    return index;
+}
+
+template <unsigned Bits>
+void CompactBSPTree<Bits>::frame(const CompactNode& node, float nodeOrigin[3], float nodeStep[3]) const {
+    for (int axis = 0; axis < 3; ++axis) {
+        nodeOrigin[axis] = origin[axis] + node.bounds[axis] * step[axis];
+        nodeStep[axis] = (node.bounds[axis + 3] - node.bounds[axis]) * step[axis] / MAX_QUANTIZED;
+    }
+}
+
+template <unsigned Bits>
+uint32_t CompactBSPTree<Bits>::polygonsEnd(uint32_t node) const {
+    return node + 1 < nodes.size() ? nodes[node + 1].firstPolygon : static_cast<uint32_t>(polygons.size());
+}
+
+template <unsigned Bits>
+uint32_t CompactBSPTree<Bits>::verticesEnd(uint32_t polygon) const {
+    return polygon + 1 < polygons.size() ? polygons[polygon + 1] : static_cast<uint32_t>(vertices.size());
+}
+
+// Upper bound of the distance error at a point: the normal error grows with the
+// distance to the plane's anchor, which lies inside the scene bounds
+template <unsigned Bits>
+float CompactBSPTree<Bits>::slack(const float point[3]) const {
+    float distance = std::sqrt(
+        (point[0] - center[0]) * (point[0] - center[0]) +
+        (point[1] - center[1]) * (point[1] - center[1]) +
+        (point[2] - center[2]) * (point[2] - center[2]));
+    return normalError * (distance + radius) + epsilon;
+}
+
+template <unsigned Bits>
+float CompactBSPTree<Bits>::signedDistance(const CompactNode& node, const float point[3]) const {
+    float normal[3];
+    decodeNormal(node.normal, normal);
+    return normal[0] * point[0] + normal[1] * point[1] + normal[2] * point[2] - node.distance;
+}
+
+template <unsigned Bits>
+RelationType CompactBSPTree<Bits>::classify(const Point3D& point, uint32_t node) const {
+    float p[3] = {point.getX().getValue(), point.getY().getValue(), point.getZ().getValue()};
+    float distance = signedDistance(nodes.at(node), p);
+    float error = slack(p);
+
+    if (distance > error) {
+        return IN_FRONT;
+    } else if (distance < -error) {
+        return BEHIND;
+    }
+    return COINCIDENT;
+}
+
+template <unsigned Bits>
+std::vector<uint32_t> CompactBSPTree<Bits>::collisionCandidates(const LineSegment& segment) const {
+    BSP_PROFILE_SCOPE(TRAVERSE);
+
+    std::vector<uint32_t> candidates;
+    if (nodes.empty()) {
+        return candidates;
+    }
+
+    Point3D a = segment.getP1();
+    Point3D b = segment.getP2();
+    float p1[3] = {a.getX().getValue(), a.getY().getValue(), a.getZ().getValue()};
+    float p2[3] = {b.getX().getValue(), b.getY().getValue(), b.getZ().getValue()};
+
+    float min[3], max[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        min[axis] = std::min(p1[axis], p2[axis]);
+        max[axis] = std::max(p1[axis], p2[axis]);
+    }
+
+    collisionCandidates(0, p1, p2, min, max, candidates);
+    return candidates;
+}
+
+// Visits the side of the first endpoint before the far side, so candidates come
+// out roughly in the order they are met along the segment
+template <unsigned Bits>
+void CompactBSPTree<Bits>::collisionCandidates(uint32_t index, const float p1[3], const float p2[3],
+                                               const float min[3], const float max[3],
+                                               std::vector<uint32_t>& out) const {
+    const CompactNode& node = nodes[index];
+    uint32_t front = getFront(index);
+    uint32_t back = getBack(index);
+    float d1 = signedDistance(node, p1);
+    float d2 = signedDistance(node, p2);
+    float e1 = slack(p1);
+    float e2 = slack(p2);
+
+    if (d1 > e1 && d2 > e2) {
+        if (front != NONE) {
+            collisionCandidates(front, p1, p2, min, max, out);
+        }
+        return;
+    }
+    if (d1 < -e1 && d2 < -e2) {
+        if (back != NONE) {
+            collisionCandidates(back, p1, p2, min, max, out);
+        }
+        return;
+    }
+
+    uint32_t nearChild = d1 >= 0 ? front : back;
+    uint32_t farChild = d1 >= 0 ? back : front;
+
+    if (nearChild != NONE) {
+        collisionCandidates(nearChild, p1, p2, min, max, out);
+    }
+    for (uint32_t i = node.firstPolygon; i < polygonsEnd(index); ++i) {
+        if (overlaps(index, i, min, max)) {
+            out.push_back(i);
+        }
+    }
+    if (farChild != NONE) {
+        collisionCandidates(farChild, p1, p2, min, max, out);
+    }
+}
+
+template <unsigned Bits>
+bool CompactBSPTree<Bits>::overlaps(uint32_t node, uint32_t polygon, const float min[3], const float max[3]) const {
+    float nodeOrigin[3], nodeStep[3];
+    frame(nodes[node], nodeOrigin, nodeStep);
+
+    for (int axis = 0; axis < 3; ++axis) {
+        uint32_t low = MAX_QUANTIZED;
+        uint32_t high = 0;
+        for (uint32_t i = polygons[polygon]; i < verticesEnd(polygon); ++i) {
+            low = std::min(low, vertices[i].get(axis));
+            high = std::max(high, vertices[i].get(axis));
+        }
+
+        float margin = nodeStep[axis] / 2 + epsilon;
+        if (nodeOrigin[axis] + low * nodeStep[axis] - margin > max[axis] ||
+            nodeOrigin[axis] + high * nodeStep[axis] + margin < min[axis]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <unsigned Bits>
+Plane CompactBSPTree<Bits>::getPartition(uint32_t node) const {
+    const CompactNode& compact = nodes.at(node);
+    float normal[3];
+    decodeNormal(compact.normal, normal);
+
+    Vector3D n(normal[0], normal[1], normal[2]);
+    return Plane(n * NType(compact.distance), n);
+}
+
+template <unsigned Bits>
+Polygon CompactBSPTree<Bits>::getPolygon(uint32_t polygon) const {
+    if (polygon >= polygons.size()) {
+        throw std::out_of_range("Polygon index out of range");
+    }
+
+    // Nodes are stored in preorder, so their polygon runs are sorted
+    auto owner = std::upper_bound(nodes.begin(), nodes.end(), polygon, [](uint32_t value, const CompactNode& node) {
+        return value < node.firstPolygon;
+    }) - 1;
+
+    float nodeOrigin[3], nodeStep[3];
+    frame(*owner, nodeOrigin, nodeStep);
+
+    std::vector<Point3D> points;
+    for (uint32_t i = polygons[polygon]; i < verticesEnd(polygon); ++i) {
+        points.emplace_back(
+            nodeOrigin[0] + vertices[i].get(0) * nodeStep[0],
+            nodeOrigin[1] + vertices[i].get(1) * nodeStep[1],
+            nodeOrigin[2] + vertices[i].get(2) * nodeStep[2]);
+    }
+    return Polygon(points);
+}
+
+template <unsigned Bits>
+size_t CompactBSPTree<Bits>::memoryUsage() const {
+    return sizeof(*this) +
+           nodes.capacity() * sizeof(CompactNode) +
+           polygons.capacity() * sizeof(uint32_t) +
+           vertices.capacity() * sizeof(QuantizedVertex<Bits>);
+}
+
+template <unsigned Bits>
+void CompactBSPTree<Bits>::bounds(const BSPNode* node, float min[3], float max[3]) {
+    for (const auto& polygon : node->polygons) {
+        for (const auto& vertex : polygon.getVertices()) {
+            float v[3] = {vertex.getX().getValue(), vertex.getY().getValue(), vertex.getZ().getValue()};
+            for (int axis = 0; axis < 3; ++axis) {
+                min[axis] = std::min(min[axis], v[axis]);
+                max[axis] = std::max(max[axis], v[axis]);
+            }
+        }
+    }
+
+    if (node->front) {
+        bounds(node->front, min, max);
+    }
+    if (node->back) {
+        bounds(node->back, min, max);
+    }
+}
+
+template <unsigned Bits>
+uint32_t CompactBSPTree<Bits>::encodeNormal(const float normal[3]) {
+    float norm = std::abs(normal[0]) + std::abs(normal[1]) + std::abs(normal[2]);
+    float u = normal[0] / norm;
+    float v = normal[1] / norm;
+
+    if (normal[2] < 0) {
+        float foldedU = (1 - std::abs(v)) * (u >= 0 ? 1 : -1);
+        float foldedV = (1 - std::abs(u)) * (v >= 0 ? 1 : -1);
+        u = foldedU;
+        v = foldedV;
+    }
+
+    auto quantize = [](float value) {
+        return static_cast<uint32_t>(static_cast<uint16_t>(static_cast<int16_t>(std::round(std::clamp(value, -1.0f, 1.0f) * 32767))));
+    };
+    return quantize(u) | (quantize(v) << 16);
+}
+
+template <unsigned Bits>
+void CompactBSPTree<Bits>::decodeNormal(uint32_t encoded, float normal[3]) {
+    float u = static_cast<int16_t>(encoded & 0xFFFF) / 32767.0f;
+    float v = static_cast<int16_t>(encoded >> 16) / 32767.0f;
+    float w = 1 - std::abs(u) - std::abs(v);
+
+    if (w < 0) {
+        float foldedU = (1 - std::abs(v)) * (u >= 0 ? 1 : -1);
+        float foldedV = (1 - std::abs(u)) * (v >= 0 ? 1 : -1);
+        u = foldedU;
+        v = foldedV;
+    }
+
+    float length = std::sqrt(u * u + v * v + w * w);
+    normal[0] = u / length;
+    normal[1] = v / length;
+    normal[2] = w / length;
+}
+
+#endif // COMPACT_BSP_HPP
@@ -4,6 +4,8 @@
 #include "data_type.hpp"
 #include "point.hpp"
 #include "line.hpp"
+#include "profiler.hpp"
+#include <algorithm>
 #include <vector>
 
 enum RelationType {
@@ -49,6 +51,8 @@ private:
 public:
     Polygon(const std::vector<Point3D>& vertices) : vertices(vertices) {}
 
+    const std::vector<Point3D>& getVertices() const { return vertices; }
+
     bool operator==(const Polygon& other) const {
         if (this->vertices.size() != other.vertices.size()) return false;
 
@@ -58,7 +62,10 @@ public:
         return true;
     }
 
+    void flip() { std::reverse(vertices.begin(), vertices.end()); }
+
     Plane computePlane() const;
+    bool isDegenerate() const;
     bool contains(const Point3D& p) const;
 
     Point3D centroid() const;
@@ -83,14 +90,14 @@ NType Plane::dist2Point(const Point3D& point) const {
 }
 
 Point3D Plane::intersect(const Line& line) const {
-    if (line.isParallel(n)) {
+    if (line.isOrthogonal(n.unit())) {
         throw std::invalid_argument("Line is parallel to plane");
     }
 
     Vector3D direction = line.getUnit();
     Point3D p0 = line.getPoint();
 
-    NType t = (n.dotProduct(Vector3D(p0 - p))) / n.dotProduct(direction);
+    NType t = (n.dotProduct(Vector3D(p - p0))) / n.dotProduct(direction);
     Point3D intersection = p0 + Point3D(direction.getX() * t, direction.getY() * t, direction.getZ() * t);
     
     return intersection;
@@ -114,24 +121,43 @@ Plane Polygon::computePlane() const {
     return Plane(vertices[0], normal);
 }
 
-bool Polygon::contains(const Point3D& point) const {
-    NType angleSum = 0;
-    const NType TWO_PI = 6.283185307179586;
-
-    for (size_t i = 0; i < vertices.size(); i++) {
-        Vector3D v1(vertices[i] - point);
-        Vector3D v2(vertices[(i + 1) % vertices.size()] - point);
+// Slivers left behind by splitting have fewer than three vertices, no usable
+// normal or an area within the epsilon; they must never become partitions
+bool Polygon::isDegenerate() const {
+    if (vertices.size() < 3 || computePlane().getNormal() == Vector3D()) {
+        return true;
+    }
 
-        NType d1 = v1.mag();
-        NType d2 = v2.mag();
+    Vector3D area;
+    for (size_t i = 1; i + 1 < vertices.size(); ++i) {
+        area += Vector3D(vertices[i] - vertices[0]).crossProduct(Vector3D(vertices[i + 1] - vertices[0]));
+    }
+    return area.mag() == NType(0);
+}
 
-        double angle = acos((v1.dotProduct(v2) / (d1 * d2)).getValue());
-        NType angleValue(angle);
+// Inside (or on the boundary of) a convex polygon, the point is on the same side
+// of every edge; points on vertices or edges give a zero and do not disqualify
+bool Polygon::contains(const Point3D& point) const {
+    Plane plane = computePlane();
+    if (plane.dist2Point(point) != NType(0)) {
+        return false;
+    }
 
-        angleSum += angleValue;
+    bool positive = false;
+    bool negative = false;
+    for (size_t i = 0; i < vertices.size(); i++) {
+        Vector3D edge(vertices[(i + 1) % vertices.size()] - vertices[i]);
+        Vector3D toPoint(point - vertices[i]);
+
+        NType side = edge.crossProduct(toPoint).dotProduct(plane.getNormal());
+        if (side > NType(0)) {
+            positive = true;
+        } else if (side < NType(0)) {
+            negative = true;
+        }
     }
 
-    return NType::abs(angleSum) == TWO_PI;
+    return !(positive && negative);
 }
 
 Point3D Polygon::centroid() const {
@@ -144,6 +170,8 @@ Point3D Polygon::centroid() const {
 }
 
 RelationType Polygon::relationWithPlane(const Plane& plane) const {
+    BSP_PROFILE_SCOPE(CLASSIFY);
+
     size_t frontCount = 0;
     size_t backCount = 0;
     
@@ -169,6 +197,8 @@ RelationType Polygon::relationWithPlane(const Plane& plane) const {
 }
 
 std::pair<Polygon, Polygon> Polygon::split(const Plane& plane) const {
+    BSP_PROFILE_SCOPE(SPLIT);
+
     std::vector<Point3D> frontVertices;
     std::vector<Point3D> backVertices;
 
@@ -179,38 +209,24 @@ std::pair<Polygon, Polygon> Polygon::split(const Plane& plane) const {
         NType currentDistance = plane.dist2Point(current);
         NType nextDistance = plane.dist2Point(next);
 
-        if (currentDistance < NType(0) && nextDistance < NType(0)) {
-            backVertices.push_back(current);
-        } else if (currentDistance > NType(0) && nextDistance > NType(0)) {
+        if (currentDistance > NType(0)) {
             frontVertices.push_back(current);
-        } else if (currentDistance == NType(0) || nextDistance == NType(0)) {
-            if (currentDistance > NType(0)) {
-                frontVertices.push_back(current);
-            } else {
-                backVertices.push_back(current);
-            }
-
-            if (nextDistance > NType(0)) {
-                frontVertices.push_back(next);
-            } else {
-                backVertices.push_back(next);
-            }
+        } else if (currentDistance < NType(0)) {
+            backVertices.push_back(current);
         } else {
-            Point3D intersection = plane.intersect(Line(current, next));
-
-            if (currentDistance > NType(0)) {
-                frontVertices.push_back(current);
-                frontVertices.push_back(intersection);
+            frontVertices.push_back(current);
+            backVertices.push_back(current);
+        }
 
-                backVertices.push_back(intersection);
-                backVertices.push_back(next);
-            } else {
-                backVertices.push_back(current);
-                backVertices.push_back(intersection);
+        if ((currentDistance > NType(0) && nextDistance < NType(0)) ||
+            (currentDistance < NType(0) && nextDistance > NType(0))) {
+            // The distances straddle zero, so this cannot divide by zero even for
+            // edges nearly parallel to the plane
+            NType t = currentDistance / (currentDistance - nextDistance);
+            Point3D intersection = current + Vector3D(next - current) * t;
 
-                frontVertices.push_back(intersection);
-                frontVertices.push_back(next);
-            }
+            frontVertices.push_back(intersection);
+            backVertices.push_back(intersection);
         }
     }
 
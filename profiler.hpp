@@ -0,0 +1,406 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+// Scoped timing of the build and query phases. Everything below is compiled out
+// unless BSP_PROFILING is defined, leaving BSP_PROFILE_SCOPE as a no-op.
+#ifdef BSP_PROFILING
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#ifndef BSP_PROFILE_BUFFER_SIZE
+#define BSP_PROFILE_BUFFER_SIZE (1 << 16)
+#endif
+
+// Threads beyond this many concurrently recording ones are not profiled
+#ifndef BSP_PROFILE_MAX_BUFFERS
+#define BSP_PROFILE_MAX_BUFFERS 64
+#endif
+
+enum class ProfilePhase : uint8_t {
+    INSERT,
+    CLASSIFY,
+    SPLIT,
+    ALLOCATE,
+    TRAVERSE,
+    COUNT
+};
+std::ostream& operator<<(std::ostream& os, const ProfilePhase& phase) {
+    switch (phase) {
+        case ProfilePhase::INSERT: return os << "insert";
+        case ProfilePhase::CLASSIFY: return os << "classify";
+        case ProfilePhase::SPLIT: return os << "split";
+        case ProfilePhase::ALLOCATE: return os << "allocate";
+        case ProfilePhase::TRAVERSE: return os << "traverse";
+        case ProfilePhase::COUNT: break;
+    }
+    return os;
+}
+
+struct ProfileEvent {
+    uint64_t start;
+    uint64_t end;
+    ProfilePhase phase;
+};
+
+// Ring buffer slot; fields are atomics so readers may copy them while the owner writes
+struct ProfileSlot {
+    std::atomic<uint64_t> start;
+    std::atomic<uint64_t> end;
+    std::atomic<ProfilePhase> phase;
+};
+
+struct PhaseSummary {
+    uint64_t count;
+    double p50; // Nanoseconds
+    double p99;
+    double p999;
+};
+
+// Written only by its owning thread. Readers copy it without locking, seqlock
+// style: claimed is read after the copy and slots the owner may have started
+// to overwrite in the meantime are dropped.
+class ProfileBuffer {
+public:
+    static constexpr size_t CAPACITY = BSP_PROFILE_BUFFER_SIZE;
+    static constexpr size_t BUCKETS = 496;
+
+private:
+    static constexpr size_t PHASES = static_cast<size_t>(ProfilePhase::COUNT);
+
+    std::vector<ProfileSlot> events;
+    std::atomic<uint64_t> head; // Events completely written
+    std::atomic<uint64_t> claimed; // Events whose slot the owner has started to write
+    std::atomic<uint64_t> base; // First event of the current owner
+    std::array<std::array<std::atomic<uint64_t>, BUCKETS>, PHASES> histograms;
+    uint32_t threadId;
+
+public:
+    ProfileBuffer(uint32_t threadId) : events(CAPACITY), head(0), claimed(0), base(0), histograms(), threadId(threadId) {}
+
+    uint32_t getThreadId() const { return threadId; }
+
+    // Hands the buffer to a new thread; histograms keep accumulating
+    void reuse() { base.store(head.load(std::memory_order_relaxed), std::memory_order_release); }
+
+    void record(ProfilePhase phase, uint64_t start, uint64_t end);
+    std::vector<ProfileEvent> snapshot() const;
+    void mergeHistogram(ProfilePhase phase, std::vector<uint64_t>& counts) const;
+
+    // Log-linear buckets: exact below 8 ticks, then 8 sub-buckets per power of two
+    static size_t bucket(uint64_t ticks);
+    static uint64_t bucketUpperBound(size_t bucket);
+};
+
+// Buffers of exited threads are retired and handed to new threads, preferably
+// once their events have been exported, so memory stays bounded by the number
+// of concurrently recording threads rather than the number ever started.
+class Profiler {
+    friend class ProfileLease;
+
+private:
+    static constexpr size_t MAX_BUFFERS = BSP_PROFILE_MAX_BUFFERS;
+
+    mutable std::mutex registryMutex; // Taken on thread start and exit, never while recording
+    std::vector<std::shared_ptr<ProfileBuffer>> buffers;
+    mutable std::vector<std::pair<std::shared_ptr<ProfileBuffer>, bool>> retired; // Exported since retiring
+    std::atomic<size_t> bufferCount; // Mirrors the sizes above for the lock-free check
+    std::atomic<size_t> retiredCount;
+    uint64_t originTicks;
+    std::chrono::steady_clock::time_point originTime;
+
+    Profiler() : bufferCount(0), retiredCount(0), originTicks(ticks()), originTime(std::chrono::steady_clock::now()) {}
+
+    std::shared_ptr<ProfileBuffer> acquire();
+    void release(std::shared_ptr<ProfileBuffer> buffer);
+    std::vector<std::shared_ptr<ProfileBuffer>> registered() const;
+    double ticksPerNanosecond() const;
+
+public:
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    static Profiler& instance() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    static uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    ProfileBuffer* threadBuffer();
+    size_t getBufferCount() const;
+
+    PhaseSummary summary(ProfilePhase phase) const;
+    static PhaseSummary summarize(const std::vector<uint64_t>& counts, double nanosecondsPerTick);
+    void exportChromeTrace(std::ostream& os) const;
+    void exportHistograms(std::ostream& os) const;
+};
+
+// Owns the calling thread's buffer and retires it when the thread exits
+class ProfileLease {
+public:
+    std::shared_ptr<ProfileBuffer> buffer;
+
+    ProfileLease() = default;
+    ~ProfileLease() {
+        if (buffer) {
+            Profiler::instance().release(std::move(buffer));
+        }
+    }
+
+    ProfileLease(const ProfileLease&) = delete;
+    ProfileLease& operator=(const ProfileLease&) = delete;
+};
+
+class ProfileScope {
+private:
+    ProfileBuffer* buffer;
+    ProfilePhase phase;
+    uint64_t start;
+
+public:
+    ProfileScope(ProfilePhase phase)
+        : buffer(Profiler::instance().threadBuffer()), phase(phase), start(Profiler::ticks()) {}
+    ~ProfileScope() {
+        if (buffer) {
+            buffer->record(phase, start, Profiler::ticks());
+        }
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+};
+
+// ProfileBuffer
+void ProfileBuffer::record(ProfilePhase phase, uint64_t start, uint64_t end) {
+    uint64_t index = head.load(std::memory_order_relaxed);
+    claimed.store(index + 1, std::memory_order_relaxed);
+
+    // Release stores rather than a fence, which thread sanitizers do not model:
+    // a reader that acquires any of these values also sees the claim above
+    ProfileSlot& slot = events[index % CAPACITY];
+    slot.start.store(start, std::memory_order_release);
+    slot.end.store(end, std::memory_order_release);
+    slot.phase.store(phase, std::memory_order_release);
+    head.store(index + 1, std::memory_order_release);
+
+    auto& counter = histograms[static_cast<size_t>(phase)][bucket(end - start)];
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+std::vector<ProfileEvent> ProfileBuffer::snapshot() const {
+    uint64_t last = head.load(std::memory_order_acquire);
+    uint64_t first = std::max<uint64_t>(last > CAPACITY ? last - CAPACITY : 0, base.load(std::memory_order_acquire));
+
+    std::vector<ProfileEvent> copy;
+    copy.reserve(last - first);
+    for (uint64_t i = first; i < last; ++i) {
+        const ProfileSlot& slot = events[i % CAPACITY];
+        copy.push_back({
+            slot.start.load(std::memory_order_acquire),
+            slot.end.load(std::memory_order_acquire),
+            slot.phase.load(std::memory_order_acquire)
+        });
+    }
+
+    uint64_t current = claimed.load(std::memory_order_relaxed);
+    uint64_t overwritten = current > CAPACITY ? current - CAPACITY : 0;
+    if (overwritten > first) {
+        copy.erase(copy.begin(), copy.begin() + std::min<uint64_t>(overwritten - first, copy.size()));
+    }
+    return copy;
+}
+
+void ProfileBuffer::mergeHistogram(ProfilePhase phase, std::vector<uint64_t>& counts) const {
+    const auto& histogram = histograms[static_cast<size_t>(phase)];
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        counts[i] += histogram[i].load(std::memory_order_relaxed);
+    }
+}
+
+size_t ProfileBuffer::bucket(uint64_t ticks) {
+    if (ticks < 8) {
+        return static_cast<size_t>(ticks);
+    }
+    int msb = 63 - __builtin_clzll(ticks);
+    return static_cast<size_t>(msb - 2) * 8 + ((ticks >> (msb - 3)) & 7);
+}
+
+uint64_t ProfileBuffer::bucketUpperBound(size_t bucket) {
+    if (bucket < 8) {
+        return bucket;
+    }
+    int shift = static_cast<int>(bucket / 8) - 1;
+    uint64_t lower = (8 + bucket % 8) << shift;
+    return lower + (uint64_t(1) << shift) - 1;
+}
+
+// Profiler
+ProfileBuffer* Profiler::threadBuffer() {
+    thread_local ProfileLease lease;
+    if (!lease.buffer && (retiredCount.load(std::memory_order_relaxed) > 0 || getBufferCount() < MAX_BUFFERS)) {
+        lease.buffer = acquire();
+    }
+    return lease.buffer.get();
+}
+
+std::shared_ptr<ProfileBuffer> Profiler::acquire() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    auto exported = std::find_if(retired.begin(), retired.end(), [](const auto& entry) { return entry.second; });
+    if (exported == retired.end() && buffers.size() >= MAX_BUFFERS) {
+        exported = retired.begin(); // Out of buffers: drop the oldest unexported events
+    }
+
+    if (exported != retired.end()) {
+        std::shared_ptr<ProfileBuffer> buffer = exported->first;
+        retired.erase(exported);
+        retiredCount.store(retired.size(), std::memory_order_relaxed);
+        buffer->reuse();
+        return buffer;
+    }
+
+    if (buffers.size() >= MAX_BUFFERS) {
+        return nullptr;
+    }
+    buffers.push_back(std::make_shared<ProfileBuffer>(static_cast<uint32_t>(buffers.size())));
+    bufferCount.store(buffers.size(), std::memory_order_relaxed);
+    return buffers.back();
+}
+
+void Profiler::release(std::shared_ptr<ProfileBuffer> buffer) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    retired.emplace_back(std::move(buffer), false);
+    retiredCount.store(retired.size(), std::memory_order_relaxed);
+}
+
+size_t Profiler::getBufferCount() const {
+    return bufferCount.load(std::memory_order_relaxed);
+}
+
+std::vector<std::shared_ptr<ProfileBuffer>> Profiler::registered() const {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    return buffers;
+}
+
+double Profiler::ticksPerNanosecond() const {
+    double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - originTime).count();
+    uint64_t now = ticks();
+    if (elapsed <= 0 || now <= originTicks) {
+        return 1;
+    }
+    return (now - originTicks) / elapsed;
+}
+
+PhaseSummary Profiler::summary(ProfilePhase phase) const {
+    std::vector<uint64_t> counts(ProfileBuffer::BUCKETS, 0);
+    for (const auto& buffer : registered()) {
+        buffer->mergeHistogram(phase, counts);
+    }
+    return summarize(counts, 1 / ticksPerNanosecond());
+}
+
+// Quantiles are upper bounds of their histogram bucket, so within 12.5% above the true value
+PhaseSummary Profiler::summarize(const std::vector<uint64_t>& counts, double nanosecondsPerTick) {
+    PhaseSummary result = {0, 0, 0, 0};
+    for (uint64_t count : counts) {
+        result.count += count;
+    }
+    if (result.count == 0) {
+        return result;
+    }
+
+    auto quantile = [&](double q) {
+        uint64_t rank = static_cast<uint64_t>(q * (result.count - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            seen += counts[i];
+            if (seen >= rank) {
+                return ProfileBuffer::bucketUpperBound(i) * nanosecondsPerTick;
+            }
+        }
+        return 0.0;
+    };
+
+    result.p50 = quantile(0.5);
+    result.p99 = quantile(0.99);
+    result.p999 = quantile(0.999);
+    return result;
+}
+
+// Complete ("X") events in the Chrome trace format; nested scopes on one
+// thread show up as a flame chart in chrome://tracing or Perfetto
+void Profiler::exportChromeTrace(std::ostream& os) const {
+    double scale = 1 / (ticksPerNanosecond() * 1000);
+    bool first = true;
+
+    std::vector<std::shared_ptr<ProfileBuffer>> retiring;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (const auto& entry : retired) {
+            retiring.push_back(entry.first);
+        }
+    }
+
+    os << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+    for (const auto& buffer : registered()) {
+        for (const auto& event : buffer->snapshot()) {
+            os << (first ? "\n" : ",\n");
+            os << "{\"name\":\"" << event.phase << "\",\"cat\":\"bsp\",\"ph\":\"X\""
+               << ",\"ts\":" << (event.start - originTicks) * scale
+               << ",\"dur\":" << (event.end - event.start) * scale
+               << ",\"pid\":0,\"tid\":" << buffer->getThreadId() << "}";
+            first = false;
+        }
+    }
+    os << "\n],\"displayTimeUnit\":\"ns\"}\n";
+
+    // Buffers retired before the export have now had all their events written
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (auto& entry : retired) {
+        if (std::find(retiring.begin(), retiring.end(), entry.first) != retiring.end()) {
+            entry.second = true;
+        }
+    }
+}
+
+void Profiler::exportHistograms(std::ostream& os) const {
+    os << std::fixed << std::setprecision(1);
+    os << "phase,count,p50_ns,p99_ns,p999_ns\n";
+    for (size_t i = 0; i < static_cast<size_t>(ProfilePhase::COUNT); ++i) {
+        ProfilePhase phase = static_cast<ProfilePhase>(i);
+        PhaseSummary result = summary(phase);
+        os << phase << "," << result.count << "," << result.p50 << "," << result.p99 << "," << result.p999 << "\n";
+    }
+}
+
+#define BSP_PROFILE_CONCAT_(a, b) a##b
+#define BSP_PROFILE_CONCAT(a, b) BSP_PROFILE_CONCAT_(a, b)
+#define BSP_PROFILE_SCOPE(phase) ProfileScope BSP_PROFILE_CONCAT(profileScope, __LINE__)(ProfilePhase::phase)
+
+#else
+
+#define BSP_PROFILE_SCOPE(phase) ((void)0)
+
+#endif // BSP_PROFILING
+
+#endif // PROFILER_HPP
@@ -0,0 +1,716 @@
+#ifndef PVS_HPP
+#define PVS_HPP
+
+#include "data_type.hpp"
+#include "point.hpp"
+#include "line.hpp"
+#include "plane.hpp"
+#include "bsp_tree.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Leaves follow the solid-leaf convention: an empty front slot of a node is an
+// empty (open) leaf, an empty back slot is solid space behind a wall.
+struct Portal {
+    Polygon polygon;
+    Plane plane; // Normal points into the front leaf
+    size_t frontLeaf;
+    size_t backLeaf;
+};
+
+class PVS {
+private:
+    struct Flow {
+        const Polygon* polygon;
+        Plane plane; // Normal points into the destination leaf
+        size_t from;
+        size_t to;
+        std::vector<uint32_t> mightSee; // Sorted flows that may continue this one
+    };
+
+    // Depth-first walk from one leaf through chains of flows
+    struct Walk {
+        const std::vector<Flow>& flows;
+        const std::vector<std::vector<size_t>>& leafFlows;
+        const Flow* source;
+        std::vector<bool> onPath;
+        std::vector<bool> seen; // Flows already known to be visible
+        std::vector<uint8_t> bits;
+    };
+
+    // One link of a chain: what is left of the source portal and of the last portal
+    // passed, and the flows that might still continue it
+    struct Link {
+        const Link* previous;
+        Polygon source;
+        Polygon pass;
+        std::vector<uint32_t> mightSee;
+    };
+
+    const BSPNode* root;
+    std::map<const BSPNode*, size_t> leafIds;
+    std::vector<Portal> portals;
+    std::vector<std::vector<uint8_t>> rows;
+
+    void numberLeaves(const BSPNode* node);
+    void generatePortals(const BSPNode* node, std::vector<std::pair<Plane, bool>>& constraints,
+                         const Point3D& center, NType radius);
+    void collect(const Polygon& polygon, const BSPNode* node, const Vector3D& towards,
+                 std::vector<std::pair<Polygon, size_t>>& out) const;
+    void descend(const Polygon& polygon, const BSPNode* node, bool front, const Vector3D& towards,
+                 std::vector<std::pair<Polygon, size_t>>& out) const;
+
+    static void flood(Walk& walk, size_t leaf, const Link& previous);
+    static void markVisible(Walk& walk, size_t flow);
+    static std::optional<Polygon> clipToSeparators(const Polygon& source, const Polygon& pass,
+                                                   const Polygon& target, bool flip);
+    static std::vector<Polygon> uncovered(const Polygon& portal, const BSPNode* node);
+    static std::optional<Polygon> clip(const Polygon& polygon, const Plane& plane, bool keepFront);
+    static Polygon baseWinding(const Plane& plane, const Point3D& center, NType radius);
+    static void bounds(const BSPNode* node, Point3D& min, Point3D& max, bool& empty);
+    static std::vector<uint8_t> compress(const std::vector<uint8_t>& bits);
+    static bool isValidRow(const std::vector<uint8_t>& row, size_t rowSize);
+    static void parallelFor(size_t count, size_t threads, const std::function<void(size_t)>& body);
+
+public:
+    static constexpr size_t SOLID_LEAF = static_cast<size_t>(-1);
+
+    PVS() : root(nullptr) {}
+
+    void build(const BSPTree& tree, size_t threads = std::thread::hardware_concurrency());
+
+    size_t getLeafCount() const { return leafIds.size(); }
+    const std::vector<Portal>& getPortals() const { return portals; }
+
+    size_t locateLeaf(const Point3D& point) const;
+    std::vector<uint8_t> visibleLeaves(size_t leaf) const;
+    bool isVisible(size_t from, size_t to) const;
+    bool isVisible(const Point3D& eye, const Point3D& target) const;
+
+    void serialize(std::ostream& os) const;
+    void deserialize(std::istream& is, const BSPTree& tree);
+};
+
+// PVS
+void PVS::build(const BSPTree& tree, size_t threads) {
+    root = tree.getRoot();
+    leafIds.clear();
+    portals.clear();
+    rows.clear();
+
+    if (root == nullptr) {
+        return;
+    }
+
+    numberLeaves(root);
+
+    Point3D min, max;
+    bool empty = true;
+    bounds(root, min, max, empty);
+
+    Point3D center = (min + max) / NType(2);
+    NType radius = min.distance(max) + NType(1);
+
+    std::vector<std::pair<Plane, bool>> constraints;
+    generatePortals(root, constraints, center, radius);
+
+    std::vector<Flow> flows;
+    std::vector<std::vector<size_t>> leafFlows(leafIds.size());
+    for (const auto& portal : portals) {
+        Plane reversed(portal.plane.getPoint(), -portal.plane.getNormal());
+
+        leafFlows[portal.frontLeaf].push_back(flows.size());
+        flows.push_back({&portal.polygon, reversed, portal.frontLeaf, portal.backLeaf});
+
+        leafFlows[portal.backLeaf].push_back(flows.size());
+        flows.push_back({&portal.polygon, portal.plane, portal.backLeaf, portal.frontLeaf});
+    }
+
+    if (flows.size() > std::numeric_limits<uint32_t>::max()) {
+        throw std::length_error("Too many portals for 32-bit flow indices");
+    }
+
+    // Basevis: a flow can only be continued by flows partly in front of it, and
+    // only if it is itself partly behind them; otherwise no sight line passes
+    // through both. Flooding through such flows bounds what each flow might see.
+    parallelFor(flows.size(), threads, [&](size_t i) {
+        std::vector<bool> ahead(flows.size(), false);
+        for (size_t j = 0; j < flows.size(); ++j) {
+            if (i == j || flows[i].polygon == flows[j].polygon) {
+                continue;
+            }
+
+            bool front = false;
+            for (const auto& vertex : flows[j].polygon->getVertices()) {
+                if (flows[i].plane.dist2Point(vertex) > NType(0)) {
+                    front = true;
+                    break;
+                }
+            }
+
+            bool behind = false;
+            for (const auto& vertex : flows[i].polygon->getVertices()) {
+                if (flows[j].plane.dist2Point(vertex) < NType(0)) {
+                    behind = true;
+                    break;
+                }
+            }
+
+            ahead[j] = front && behind;
+        }
+
+        std::vector<bool> reached(flows.size(), false);
+        std::vector<size_t> stack{flows[i].to};
+        while (!stack.empty()) {
+            size_t current = stack.back();
+            stack.pop_back();
+
+            for (size_t next : leafFlows[current]) {
+                if (ahead[next] && !reached[next]) {
+                    reached[next] = true;
+                    flows[i].mightSee.push_back(static_cast<uint32_t>(next));
+                    stack.push_back(flows[next].to);
+                }
+            }
+        }
+        std::sort(flows[i].mightSee.begin(), flows[i].mightSee.end());
+    });
+
+    size_t rowSize = (leafIds.size() + 7) / 8;
+    rows.resize(leafIds.size());
+    parallelFor(leafIds.size(), threads, [&](size_t leaf) {
+        Walk walk{flows, leafFlows, nullptr,
+                  std::vector<bool>(leafIds.size(), false),
+                  std::vector<bool>(flows.size(), false),
+                  std::vector<uint8_t>(rowSize, 0)};
+        walk.bits[leaf / 8] |= 1 << (leaf % 8);
+        walk.onPath[leaf] = true;
+
+        for (size_t start : leafFlows[leaf]) {
+            const Flow& flow = flows[start];
+            walk.source = &flow;
+            markVisible(walk, start);
+
+            Link head{nullptr, *flow.polygon, *flow.polygon, flow.mightSee};
+            flood(walk, flow.to, head);
+        }
+
+        rows[leaf] = compress(walk.bits);
+    });
+}
+
+// Follows every chain of flows out of leaf that a sight line from the source
+// portal could pass through. Past the first portal, the next one is clipped to
+// the separating planes between what is left of the source and of the portal
+// passed last; if nothing remains, no line passes through the whole chain.
+void PVS::flood(Walk& walk, size_t leaf, const Link& previous) {
+    walk.onPath[leaf] = true;
+
+    for (size_t index : walk.leafFlows[leaf]) {
+        const Flow& flow = walk.flows[index];
+        if (walk.onPath[flow.to] ||
+            !std::binary_search(previous.mightSee.begin(), previous.mightSee.end(), static_cast<uint32_t>(index))) {
+            continue;
+        }
+
+        std::vector<uint32_t> mightSee;
+        std::set_intersection(previous.mightSee.begin(), previous.mightSee.end(),
+                              flow.mightSee.begin(), flow.mightSee.end(), std::back_inserter(mightSee));
+
+        // Nothing new can be found past a flow that is already visible
+        bool more = std::any_of(mightSee.begin(), mightSee.end(), [&](uint32_t next) {
+            return !walk.seen[next];
+        });
+        if (!more && walk.seen[index]) {
+            continue;
+        }
+
+        std::optional<Polygon> pass = clip(*flow.polygon, walk.source->plane, true);
+        if (!pass) {
+            continue;
+        }
+        std::optional<Polygon> source = clip(previous.source, flow.plane, false);
+        if (!source) {
+            continue;
+        }
+
+        if (previous.previous != nullptr) {
+            pass = clipToSeparators(*source, previous.pass, *pass, false);
+            if (pass) {
+                pass = clipToSeparators(previous.pass, *source, *pass, true);
+            }
+            if (!pass) {
+                continue;
+            }
+        }
+
+        markVisible(walk, index);
+        flood(walk, flow.to, Link{&previous, *source, *pass, std::move(mightSee)});
+    }
+
+    walk.onPath[leaf] = false;
+}
+
+void PVS::markVisible(Walk& walk, size_t flow) {
+    size_t leaf = walk.flows[flow].to;
+    walk.seen[flow] = true;
+    walk.bits[leaf / 8] |= 1 << (leaf % 8);
+}
+
+// A plane through an edge of source and a vertex of pass that has the two on
+// opposite sides bounds every sight line through both; target keeps the side
+// pass is on, or the side opposite pass when flip is set.
+std::optional<Polygon> PVS::clipToSeparators(const Polygon& source, const Polygon& pass,
+                                             const Polygon& target, bool flip) {
+    const auto& sourceVertices = source.getVertices();
+    const auto& passVertices = pass.getVertices();
+    std::optional<Polygon> clipped = target;
+
+    for (size_t i = 0; i < sourceVertices.size(); ++i) {
+        size_t next = (i + 1) % sourceVertices.size();
+        Vector3D edge(sourceVertices[next] - sourceVertices[i]);
+
+        for (size_t j = 0; j < passVertices.size(); ++j) {
+            Vector3D normal = edge.crossProduct(Vector3D(passVertices[j] - sourceVertices[i]));
+            if (normal.mag() == NType(0)) {
+                continue;
+            }
+            Plane plane(passVertices[j], normal.unit());
+
+            // Turn the plane so source lies behind it; planes containing source are useless
+            bool oriented = false;
+            for (size_t k = 0; k < sourceVertices.size() && !oriented; ++k) {
+                if (k == i || k == next) {
+                    continue;
+                }
+
+                NType distance = plane.dist2Point(sourceVertices[k]);
+                if (distance < NType(0)) {
+                    oriented = true;
+                } else if (distance > NType(0)) {
+                    plane = Plane(passVertices[j], -plane.getNormal());
+                    oriented = true;
+                }
+            }
+            if (!oriented) {
+                continue;
+            }
+
+            // Separating only if pass is entirely in front and not lying on the plane
+            bool separates = true;
+            bool ahead = false;
+            for (size_t k = 0; k < passVertices.size() && separates; ++k) {
+                NType distance = plane.dist2Point(passVertices[k]);
+                if (distance < NType(0)) {
+                    separates = false;
+                } else if (distance > NType(0)) {
+                    ahead = true;
+                }
+            }
+            if (!separates || !ahead) {
+                continue;
+            }
+
+            clipped = clip(*clipped, plane, !flip);
+            if (!clipped) {
+                return std::nullopt;
+            }
+        }
+    }
+    return clipped;
+}
+
+size_t PVS::locateLeaf(const Point3D& point) const {
+    const BSPNode* node = root;
+    while (node != nullptr) {
+        if (node->partition.dist2Point(point) < NType(0)) {
+            if (node->back == nullptr) {
+                return SOLID_LEAF;
+            }
+            node = node->back;
+        } else {
+            if (node->front == nullptr) {
+                return leafIds.at(node);
+            }
+            node = node->front;
+        }
+    }
+    return SOLID_LEAF;
+}
+
+std::vector<uint8_t> PVS::visibleLeaves(size_t leaf) const {
+    if (leaf >= rows.size()) {
+        throw std::out_of_range("Leaf index out of range");
+    }
+
+    std::vector<uint8_t> bits;
+    bits.reserve((rows.size() + 7) / 8);
+
+    const auto& row = rows[leaf];
+    for (size_t i = 0; i < row.size(); ++i) {
+        if (row[i] == 0) {
+            bits.insert(bits.end(), row[++i], 0);
+        } else {
+            bits.push_back(row[i]);
+        }
+    }
+    return bits;
+}
+
+bool PVS::isVisible(size_t from, size_t to) const {
+    if (from >= rows.size() || to >= rows.size()) {
+        throw std::out_of_range("Leaf index out of range");
+    }
+
+    size_t target = to / 8;
+    size_t position = 0;
+
+    const auto& row = rows[from];
+    for (size_t i = 0; i < row.size(); ++i) {
+        if (row[i] == 0) {
+            position += row[++i];
+            if (position > target) {
+                return false;
+            }
+        } else if (position++ == target) {
+            return (row[i] >> (to % 8)) & 1;
+        }
+    }
+    return false;
+}
+
+bool PVS::isVisible(const Point3D& eye, const Point3D& target) const {
+    size_t from = locateLeaf(eye);
+    size_t to = locateLeaf(target);
+
+    // Points inside solid space cannot be classified; never cull them
+    if (from == SOLID_LEAF || to == SOLID_LEAF) {
+        return true;
+    }
+    return isVisible(from, to);
+}
+
+void PVS::serialize(std::ostream& os) const {
+    uint32_t leafCount = static_cast<uint32_t>(rows.size());
+    os.write("PVS1", 4);
+    os.write(reinterpret_cast<const char*>(&leafCount), sizeof(leafCount));
+
+    for (const auto& row : rows) {
+        uint32_t size = static_cast<uint32_t>(row.size());
+        os.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        os.write(reinterpret_cast<const char*>(row.data()), size);
+    }
+}
+
+void PVS::deserialize(std::istream& is, const BSPTree& tree) {
+    root = tree.getRoot();
+    leafIds.clear();
+    portals.clear();
+    rows.clear();
+
+    if (root != nullptr) {
+        numberLeaves(root);
+    }
+
+    char magic[4];
+    uint32_t leafCount = 0;
+    is.read(magic, 4);
+    is.read(reinterpret_cast<char*>(&leafCount), sizeof(leafCount));
+
+    if (!is || std::string(magic, 4) != "PVS1") {
+        throw std::runtime_error("Invalid PVS data");
+    }
+    if (leafCount != leafIds.size()) {
+        throw std::runtime_error("PVS data does not match the tree");
+    }
+
+    // A compressed row never exceeds two bytes per decoded byte
+    size_t rowSize = (leafCount + 7) / 8;
+    rows.resize(leafCount);
+    for (auto& row : rows) {
+        uint32_t size = 0;
+        is.read(reinterpret_cast<char*>(&size), sizeof(size));
+        if (!is) {
+            throw std::runtime_error("Truncated PVS data");
+        }
+        if (size > 2 * rowSize) {
+            throw std::runtime_error("Invalid PVS row");
+        }
+
+        row.resize(size);
+        is.read(reinterpret_cast<char*>(row.data()), size);
+        if (!is) {
+            throw std::runtime_error("Truncated PVS data");
+        }
+        if (!isValidRow(row, rowSize)) {
+            throw std::runtime_error("Invalid PVS row");
+        }
+    }
+}
+
+// Every zero byte must be followed by a non-zero run length, and the row must
+// decode to exactly rowSize bytes
+bool PVS::isValidRow(const std::vector<uint8_t>& row, size_t rowSize) {
+    size_t decoded = 0;
+    for (size_t i = 0; i < row.size(); ++i) {
+        if (row[i] != 0) {
+            ++decoded;
+        } else if (i + 1 >= row.size() || row[i + 1] == 0) {
+            return false;
+        } else {
+            decoded += row[++i];
+        }
+
+        if (decoded > rowSize) {
+            return false;
+        }
+    }
+    return decoded == rowSize;
+}
+
+void PVS::numberLeaves(const BSPNode* node) {
+    if (node->front == nullptr) {
+        leafIds.emplace(node, leafIds.size());
+    } else {
+        numberLeaves(node->front);
+    }
+
+    if (node->back != nullptr) {
+        numberLeaves(node->back);
+    }
+}
+
+void PVS::generatePortals(const BSPNode* node, std::vector<std::pair<Plane, bool>>& constraints,
+                          const Point3D& center, NType radius) {
+    Plane plane(node->partition.getPoint(), node->partition.getNormal().unit());
+    std::optional<Polygon> winding = baseWinding(plane, center, radius);
+
+    // Restrict the winding to the region of space the node covers
+    for (const auto& [ancestor, keepFront] : constraints) {
+        winding = clip(*winding, ancestor, keepFront);
+        if (!winding) {
+            break;
+        }
+    }
+
+    // Nothing behind the node means solid space, so no portal can be opened
+    if (winding && node->back != nullptr) {
+        std::vector<std::pair<Polygon, size_t>> fronts;
+        if (node->front == nullptr) {
+            fronts.emplace_back(*winding, leafIds.at(node));
+        } else {
+            collect(*winding, node->front, plane.getNormal(), fronts);
+        }
+
+        for (const auto& [fragment, frontLeaf] : fronts) {
+            std::vector<std::pair<Polygon, size_t>> backs;
+            collect(fragment, node->back, -plane.getNormal(), backs);
+
+            for (const auto& [fragment, backLeaf] : backs) {
+                for (const auto& portal : uncovered(fragment, node)) {
+                    portals.push_back({portal, plane, frontLeaf, backLeaf});
+                }
+            }
+        }
+    }
+
+    if (node->front != nullptr) {
+        constraints.emplace_back(node->partition, true);
+        generatePortals(node->front, constraints, center, radius);
+        constraints.pop_back();
+    }
+    if (node->back != nullptr) {
+        constraints.emplace_back(node->partition, false);
+        generatePortals(node->back, constraints, center, radius);
+        constraints.pop_back();
+    }
+}
+
+void PVS::collect(const Polygon& polygon, const BSPNode* node, const Vector3D& towards,
+                  std::vector<std::pair<Polygon, size_t>>& out) const {
+    RelationType relation = polygon.relationWithPlane(node->partition);
+
+    if (relation == RelationType::IN_FRONT) {
+        descend(polygon, node, true, towards, out);
+    } else if (relation == RelationType::BEHIND) {
+        descend(polygon, node, false, towards, out);
+    } else if (relation == RelationType::COINCIDENT) {
+        descend(polygon, node, node->partition.getNormal().dotProduct(towards) > NType(0), towards, out);
+    } else {
+        auto [frontPoly, backPoly] = polygon.split(node->partition);
+        descend(frontPoly, node, true, towards, out);
+        descend(backPoly, node, false, towards, out);
+    }
+}
+
+void PVS::descend(const Polygon& polygon, const BSPNode* node, bool front, const Vector3D& towards,
+                  std::vector<std::pair<Polygon, size_t>>& out) const {
+    if (polygon.isDegenerate()) {
+        return;
+    }
+
+    const BSPNode* child = front ? node->front : node->back;
+    if (child != nullptr) {
+        collect(polygon, child, towards, out);
+    } else if (front) {
+        out.emplace_back(polygon, leafIds.at(node));
+    }
+}
+
+// Polygons lying on the partition are opaque, so they are cut out of the portal.
+// Each (convex) wall is subtracted by clipping against its edge planes: the parts
+// outside an edge stay open, the part inside all edges is dropped.
+std::vector<Polygon> PVS::uncovered(const Polygon& portal, const BSPNode* node) {
+    std::vector<Polygon> open{portal};
+
+    for (const auto& wall : node->polygons) {
+        if (wall.isDegenerate()) {
+            continue;
+        }
+        const auto& corners = wall.getVertices();
+
+        Vector3D normal = node->partition.getNormal();
+        Point3D center = wall.centroid();
+
+        std::vector<Polygon> remaining;
+        for (const auto& fragment : open) {
+            std::optional<Polygon> inside = fragment;
+
+            for (size_t i = 0; i < corners.size() && inside; ++i) {
+                Vector3D edge(corners[(i + 1) % corners.size()] - corners[i]);
+                Vector3D outward = edge.crossProduct(normal);
+                if (outward.mag() == NType(0)) {
+                    continue;
+                }
+
+                Plane edgePlane(corners[i], outward.unit());
+                if (edgePlane.dist2Point(center) > NType(0)) {
+                    edgePlane = Plane(corners[i], -outward.unit());
+                }
+
+                RelationType relation = inside->relationWithPlane(edgePlane);
+                if (relation == RelationType::IN_FRONT) {
+                    remaining.push_back(*inside);
+                    inside.reset();
+                } else if (relation == RelationType::SPANNING) {
+                    auto [outsidePart, insidePart] = inside->split(edgePlane);
+                    if (!outsidePart.isDegenerate()) {
+                        remaining.push_back(outsidePart);
+                    }
+                    inside = insidePart.isDegenerate() ? std::nullopt : std::optional<Polygon>(insidePart);
+                }
+            }
+        }
+        open = std::move(remaining);
+    }
+    return open;
+}
+
+std::optional<Polygon> PVS::clip(const Polygon& polygon, const Plane& plane, bool keepFront) {
+    RelationType relation = polygon.relationWithPlane(plane);
+
+    if (relation == RelationType::COINCIDENT) {
+        return polygon;
+    } else if (relation == RelationType::IN_FRONT) {
+        return keepFront ? std::optional<Polygon>(polygon) : std::nullopt;
+    } else if (relation == RelationType::BEHIND) {
+        return keepFront ? std::nullopt : std::optional<Polygon>(polygon);
+    }
+
+    auto [frontPoly, backPoly] = polygon.split(plane);
+    const Polygon& kept = keepFront ? frontPoly : backPoly;
+    if (kept.isDegenerate()) {
+        return std::nullopt;
+    }
+    return kept;
+}
+
+Polygon PVS::baseWinding(const Plane& plane, const Point3D& center, NType radius) {
+    Vector3D normal = plane.getNormal();
+    Vector3D axis = abs(normal.getX()) < NType(0.9f) ? Vector3D(1, 0, 0) : Vector3D(0, 1, 0);
+
+    Vector3D u = axis.crossProduct(normal).unit() * radius;
+    Vector3D v = normal.crossProduct(u);
+    Vector3D origin = Vector3D(center) - normal * plane.dist2Point(center);
+
+    return Polygon({
+        origin + u + v,
+        origin - u + v,
+        origin - u - v,
+        origin + u - v
+    });
+}
+
+void PVS::bounds(const BSPNode* node, Point3D& min, Point3D& max, bool& empty) {
+    for (const auto& polygon : node->polygons) {
+        for (const auto& vertex : polygon.getVertices()) {
+            if (empty) {
+                min = max = vertex;
+                empty = false;
+                continue;
+            }
+            min = Point3D(::min(min.getX(), vertex.getX()), ::min(min.getY(), vertex.getY()), ::min(min.getZ(), vertex.getZ()));
+            max = Point3D(::max(max.getX(), vertex.getX()), ::max(max.getY(), vertex.getY()), ::max(max.getZ(), vertex.getZ()));
+        }
+    }
+
+    if (node->front) {
+        bounds(node->front, min, max, empty);
+    }
+    if (node->back) {
+        bounds(node->back, min, max, empty);
+    }
+}
+
+// Runs of zero bytes are stored as a zero followed by the run length
+std::vector<uint8_t> PVS::compress(const std::vector<uint8_t>& bits) {
+    std::vector<uint8_t> compressed;
+    for (size_t i = 0; i < bits.size(); ++i) {
+        if (bits[i] != 0) {
+            compressed.push_back(bits[i]);
+            continue;
+        }
+
+        uint8_t run = 1;
+        while (i + 1 < bits.size() && bits[i + 1] == 0 && run < 255) {
+            ++run;
+            ++i;
+        }
+        compressed.push_back(0);
+        compressed.push_back(run);
+    }
+    return compressed;
+}
+
+void PVS::parallelFor(size_t count, size_t threads, const std::function<void(size_t)>& body) {
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            body(i);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < std::min(threads, count); ++t) {
+        pool.emplace_back(worker);
+    }
+    worker();
+
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
+
+#endif // PVS_HPP
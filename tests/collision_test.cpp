@@ -0,0 +1,67 @@
+#include "../bsp_tree.hpp"
+#include <cassert>
+
+// Unit quad on z = 0 facing +z
+Polygon quad() {
+    return Polygon({Point3D(0, 0, 0), Point3D(1, 0, 0), Point3D(1, 1, 0), Point3D(0, 1, 0)});
+}
+
+void testContains() {
+    Polygon polygon = quad();
+
+    assert(polygon.contains(Point3D(0.5, 0.5, 0)));
+    assert(polygon.contains(Point3D(0, 0, 0)));
+    assert(polygon.contains(Point3D(0, 0.5, 0)));
+    assert(!polygon.contains(Point3D(1.5, 0.5, 0)));
+    assert(!polygon.contains(Point3D(0.5, 0.5, 1)));
+}
+
+void testHit() {
+    BSPTree tree;
+    tree.insert(quad());
+
+    assert(tree.detectCollision(LineSegment(Point3D(0.5, 0.5, -1), Point3D(0.5, 0.5, 1))) != nullptr);
+    assert(tree.detectCollision(LineSegment(Point3D(0.5, 0.5, 1), Point3D(0.5, 0.5, -1))) != nullptr);
+    assert(tree.detectCollision(LineSegment(Point3D(2, 0.5, -1), Point3D(2, 0.5, 1))) == nullptr);
+    assert(tree.detectCollision(LineSegment(Point3D(0.5, 0.5, 1), Point3D(0.5, 0.5, 2))) == nullptr);
+}
+
+void testShallowSegment() {
+    BSPTree tree;
+    tree.insert(quad());
+
+    // Nearly parallel to the plane, crossing it at (0, 0.5, 0)
+    assert(tree.detectCollision(LineSegment(Point3D(-10000, 0.5, -0.4), Point3D(10000, 0.5, 0.4))) != nullptr);
+}
+
+void testThroughVertex() {
+    BSPTree tree;
+    tree.insert(quad());
+
+    assert(tree.detectCollision(LineSegment(Point3D(0, 0, -1), Point3D(0, 0, 1))) != nullptr);
+}
+
+void testNearestHit() {
+    BSPTree tree;
+    Polygon nearQuad = quad();
+    Polygon farQuad({Point3D(0, 0, 5), Point3D(1, 0, 5), Point3D(1, 1, 5), Point3D(0, 1, 5)});
+    tree.insert(nearQuad);
+    tree.insert(farQuad);
+
+    const Polygon* hit = tree.detectCollision(LineSegment(Point3D(0.5, 0.5, -1), Point3D(0.5, 0.5, 6)));
+    assert(hit != nullptr && *hit == nearQuad);
+
+    hit = tree.detectCollision(LineSegment(Point3D(0.5, 0.5, 6), Point3D(0.5, 0.5, -1)));
+    assert(hit != nullptr && *hit == farQuad);
+}
+
+int main() {
+    testContains();
+    testHit();
+    testShallowSegment();
+    testThroughVertex();
+    testNearestHit();
+
+    std::cout << "collision_test passed" << std::endl;
+    return 0;
+}
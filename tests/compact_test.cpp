@@ -0,0 +1,194 @@
+#include "../compact_bsp.hpp"
+#include <cassert>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <random>
+
+// Randomly placed and oriented polygons, either triangles or quads
+BSPTree randomTree(unsigned seed, size_t count, size_t corners) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> position(-50, 50);
+    std::uniform_real_distribution<float> size(0.5, 3);
+
+    BSPTree tree;
+    for (size_t i = 0; i < count; ++i) {
+        Point3D center(position(rng), position(rng), position(rng));
+        Vector3D normal = Vector3D(position(rng), position(rng), position(rng)).unit();
+        Vector3D u = normal.crossProduct(Vector3D(0.3f, 0.5f, 0.8f)).unit() * NType(size(rng));
+        Vector3D v = normal.crossProduct(u);
+
+        if (corners == 3) {
+            tree.insert(Polygon({center + u, center - u + v, center - u - v}));
+        } else {
+            tree.insert(Polygon({center + u + v, center - u + v, center - u - v, center + u - v}));
+        }
+    }
+    return tree;
+}
+
+// Object bytes of the pointer-based tree, ignoring allocator overhead
+size_t originalBytes(const BSPNode* node) {
+    if (node == nullptr) {
+        return 0;
+    }
+
+    size_t bytes = sizeof(BSPNode) + node->polygons.capacity() * sizeof(Polygon);
+    for (const auto& polygon : node->polygons) {
+        bytes += polygon.getVertices().capacity() * sizeof(Point3D);
+    }
+    return bytes + originalBytes(node->front) + originalBytes(node->back);
+}
+
+// Compact polygons are numbered in preorder, node polygons first
+void numberPolygons(const BSPNode* node, std::map<const Polygon*, uint32_t>& ids) {
+    if (node == nullptr) {
+        return;
+    }
+    for (const auto& polygon : node->polygons) {
+        ids.emplace(&polygon, static_cast<uint32_t>(ids.size()));
+    }
+    numberPolygons(node->front, ids);
+    numberPolygons(node->back, ids);
+}
+
+template <unsigned Bits>
+void testCandidatesSuperset(const BSPTree& tree) {
+    CompactBSPTree<Bits> compact(tree);
+    std::map<const Polygon*, uint32_t> ids;
+    numberPolygons(tree.getRoot(), ids);
+    assert(compact.getPolygonsCount() == ids.size());
+
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> position(-60, 60);
+
+    std::vector<LineSegment> segments;
+    for (int i = 0; i < 500; ++i) {
+        segments.emplace_back(Point3D(position(rng), position(rng), position(rng)),
+                              Point3D(position(rng), position(rng), position(rng)));
+    }
+    // Short segments through each polygon are guaranteed hits
+    for (const auto& [polygon, id] : ids) {
+        Point3D center = polygon->centroid();
+        Vector3D normal = polygon->computePlane().getNormal();
+        segments.emplace_back(center + normal * NType(0.01f), center - normal * NType(0.01f));
+    }
+
+    size_t hits = 0;
+    for (const auto& segment : segments) {
+        const Polygon* hit = tree.detectCollision(segment);
+        if (hit == nullptr) {
+            continue;
+        }
+        ++hits;
+
+        std::vector<uint32_t> candidates = compact.collisionCandidates(segment);
+        assert(std::find(candidates.begin(), candidates.end(), ids.at(hit)) != candidates.end());
+    }
+    assert(hits >= ids.size());
+}
+
+template <unsigned Bits>
+void testConservativeClassify(const BSPTree& tree) {
+    CompactBSPTree<Bits> compact(tree);
+
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> position(-150, 150);
+
+    std::function<void(const BSPNode*, uint32_t)> check = [&](const BSPNode* node, uint32_t index) {
+        if (node == nullptr) {
+            assert(index == CompactBSPTree<Bits>::NONE);
+            return;
+        }
+
+        for (int i = 0; i < 20; ++i) {
+            Point3D point(position(rng), position(rng), position(rng));
+            NType distance = node->partition.dist2Point(point);
+            RelationType relation = compact.classify(point, index);
+
+            assert(!(distance > NType(0) && relation == BEHIND));
+            assert(!(distance < NType(0) && relation == IN_FRONT));
+        }
+
+        // Points on the original polygons never land strictly on one side
+        for (const auto& polygon : node->polygons) {
+            for (const auto& vertex : polygon.getVertices()) {
+                assert(compact.classify(vertex, index) == COINCIDENT);
+            }
+        }
+
+        check(node->front, compact.getFront(index));
+        check(node->back, compact.getBack(index));
+    };
+    check(tree.getRoot(), compact.getRoot());
+}
+
+void testRoundTrip(const BSPTree& tree) {
+    CompactBSPTree<21> compact(tree);
+    std::vector<Polygon> polygons = tree.getPolygons();
+
+    for (uint32_t i = 0; i < polygons.size(); ++i) {
+        Polygon polygon = compact.getPolygon(i);
+        const auto& original = polygons[i].getVertices();
+        const auto& decoded = polygon.getVertices();
+
+        assert(original.size() == decoded.size());
+        for (size_t j = 0; j < original.size(); ++j) {
+            assert(original[j].distance(decoded[j]).getValue() < 1e-2f);
+        }
+    }
+}
+
+void testMemory() {
+    BSPTree quads = randomTree(1, 400, 4);
+    BSPTree triangles = randomTree(2, 400, 3);
+
+    assert(sizeof(CompactNode) == 24);
+
+    size_t quadBytes = originalBytes(quads.getRoot());
+    assert(CompactBSPTree<16>(quads).memoryUsage() * 2.7 < quadBytes);
+    assert(CompactBSPTree<21>(quads).memoryUsage() * 2.3 < quadBytes);
+
+    size_t triangleBytes = originalBytes(triangles.getRoot());
+    assert(CompactBSPTree<16>(triangles).memoryUsage() * 2.7 < triangleBytes);
+    assert(CompactBSPTree<21>(triangles).memoryUsage() * 2.3 < triangleBytes);
+}
+
+void testDegeneratePartition() {
+    BSPTree tree;
+    tree.insert(Polygon({Point3D(0, 0, 0), Point3D(1, 0, 0), Point3D(0, 1, 0)}));
+    tree.getRoot()->partition = Plane(Point3D(0, 0, 0), Vector3D(0, 0, 0));
+
+    bool thrown = false;
+    try {
+        CompactBSPTree<16> compact(tree);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+void testEmpty() {
+    CompactBSPTree<16> compact{BSPTree()};
+
+    assert(compact.getRoot() == CompactBSPTree<16>::NONE);
+    assert(compact.collisionCandidates(LineSegment(Point3D(0, 0, 0), Point3D(1, 1, 1))).empty());
+}
+
+int main() {
+    for (unsigned seed = 0; seed < 3; ++seed) {
+        BSPTree tree = randomTree(seed, 400, seed % 2 ? 3 : 4);
+
+        testCandidatesSuperset<16>(tree);
+        testCandidatesSuperset<21>(tree);
+        testConservativeClassify<16>(tree);
+        testConservativeClassify<21>(tree);
+        testRoundTrip(tree);
+    }
+    testMemory();
+    testDegeneratePartition();
+    testEmpty();
+
+    std::cout << "compact_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include "../bsp_tree.hpp"
+#include <cassert>
+#include <cmath>
+
+// Axis-aligned cube [low, high]^3 with outward-facing sides
+std::vector<Polygon> cube(float low, float high) {
+    auto corner = [&](int x, int y, int z) {
+        return Point3D(x ? high : low, y ? high : low, z ? high : low);
+    };
+    return {
+        Polygon({corner(0, 0, 0), corner(0, 0, 1), corner(0, 1, 1), corner(0, 1, 0)}),
+        Polygon({corner(1, 0, 0), corner(1, 1, 0), corner(1, 1, 1), corner(1, 0, 1)}),
+        Polygon({corner(0, 0, 0), corner(1, 0, 0), corner(1, 0, 1), corner(0, 0, 1)}),
+        Polygon({corner(0, 1, 0), corner(0, 1, 1), corner(1, 1, 1), corner(1, 1, 0)}),
+        Polygon({corner(0, 0, 0), corner(0, 1, 0), corner(1, 1, 0), corner(1, 0, 0)}),
+        Polygon({corner(0, 0, 1), corner(1, 0, 1), corner(1, 1, 1), corner(0, 1, 1)}),
+    };
+}
+
+BSPTree solid(float low, float high) {
+    BSPTree tree;
+    tree.insert(cube(low, high));
+    return tree;
+}
+
+float area(const BSPTree& tree) {
+    float total = 0;
+    for (const auto& polygon : tree.getPolygons()) {
+        const auto& vertices = polygon.getVertices();
+
+        Vector3D sum;
+        for (size_t i = 1; i + 1 < vertices.size(); ++i) {
+            sum += Vector3D(vertices[i] - vertices[0]).crossProduct(Vector3D(vertices[i + 1] - vertices[0]));
+        }
+        total += sum.mag().getValue() / 2;
+    }
+    return total;
+}
+
+bool near(float value, float expected) {
+    return std::fabs(value - expected) < 1e-3f;
+}
+
+void testOverlappingCubes(size_t parallelDepth) {
+    BSPTree a = solid(0, 2);
+    BSPTree b = solid(1, 3);
+
+    BSPTree united = a.unite(b, parallelDepth);
+    assert(near(area(united), 42));
+    assert(united.isInside(Point3D(0.5, 0.5, 0.5)));
+    assert(united.isInside(Point3D(1.5, 1.5, 1.5)));
+    assert(united.isInside(Point3D(2.5, 2.5, 2.5)));
+    assert(!united.isInside(Point3D(0.5, 2.5, 0.5)));
+    assert(!united.isInside(Point3D(5, 5, 5)));
+
+    BSPTree intersection = a.intersect(b, parallelDepth);
+    assert(near(area(intersection), 6));
+    assert(intersection.isInside(Point3D(1.5, 1.5, 1.5)));
+    assert(!intersection.isInside(Point3D(0.5, 0.5, 0.5)));
+    assert(!intersection.isInside(Point3D(2.5, 2.5, 2.5)));
+
+    BSPTree difference = a.subtract(b, parallelDepth);
+    assert(near(area(difference), 24));
+    assert(difference.isInside(Point3D(0.5, 0.5, 0.5)));
+    assert(difference.isInside(Point3D(1.5, 0.5, 1.5)));
+    assert(!difference.isInside(Point3D(1.5, 1.5, 1.5)));
+    assert(!difference.isInside(Point3D(2.5, 2.5, 2.5)));
+
+    // The operands are left untouched
+    assert(near(area(a), 24) && near(area(b), 24));
+}
+
+// Forked subtrees clip disjoint polygons, so the result matches the serial one
+void testParallelMatchesSerial() {
+    BSPTree a = solid(0, 2);
+    BSPTree b = solid(1, 3);
+
+    assert(a.unite(b, 0).getPolygons() == a.unite(b, 4).getPolygons());
+    assert(a.intersect(b, 0).getPolygons() == a.intersect(b, 4).getPolygons());
+    assert(a.subtract(b, 0).getPolygons() == a.subtract(b, 4).getPolygons());
+}
+
+void testEmptyOperands() {
+    BSPTree a = solid(0, 2);
+    BSPTree empty;
+
+    assert(near(area(a.unite(empty)), 24));
+    assert(near(area(empty.unite(a)), 24));
+    assert(a.intersect(empty).isEmpty());
+    assert(empty.intersect(a).isEmpty());
+    assert(near(area(a.subtract(empty)), 24));
+    assert(empty.subtract(a).isEmpty());
+    assert(empty.unite(empty).isEmpty());
+}
+
+void testSelfSubtraction() {
+    BSPTree a = solid(0, 2);
+
+    assert(near(area(a.subtract(a)), 0));
+    assert(near(area(a.unite(a)), 24));
+    assert(near(area(a.intersect(a)), 24));
+}
+
+void testCopyAndMove() {
+    BSPTree a = solid(0, 2);
+
+    BSPTree copy(a);
+    copy.insert(cube(5, 6));
+    assert(a.getPolygonsCount() == 6);
+    assert(copy.getPolygonsCount() == 12);
+
+    BSPTree assigned;
+    assigned = a;
+    assert(assigned.getPolygons() == a.getPolygons());
+    assert(assigned.getRoot() != a.getRoot());
+
+    BSPTree moved(std::move(copy));
+    assert(copy.isEmpty());
+    assert(moved.getPolygonsCount() == 12);
+
+    assigned = std::move(moved);
+    assert(assigned.getPolygonsCount() == 12);
+}
+
+int main() {
+    testOverlappingCubes(0);
+    testOverlappingCubes(4);
+    testParallelMatchesSerial();
+    testEmptyOperands();
+    testSelfSubtraction();
+    testCopyAndMove();
+
+    std::cout << "csg_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,180 @@
+#define BSP_PROFILING
+#define BSP_PROFILE_BUFFER_SIZE 1024
+#define BSP_PROFILE_MAX_BUFFERS 8
+
+#include "../bsp_tree.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <thread>
+
+Polygon triangle() {
+    return Polygon({Point3D(0, 0, 0), Point3D(1, 0, 0), Point3D(1, 1, 0)});
+}
+
+// Run under -fsanitize=thread to check that exporting never races with recording
+void testExportWhileRecording() {
+    std::atomic<bool> started(false);
+    std::atomic<bool> stop(false);
+    std::thread writer([&]() {
+        Polygon polygon = triangle();
+        Plane plane(Point3D(0, 0, 1), Vector3D(0, 0, 1));
+        while (!stop) {
+            polygon.relationWithPlane(plane);
+            started = true;
+        }
+    });
+
+    while (!started) {
+        std::this_thread::yield();
+    }
+
+    for (int i = 0; i < 50; ++i) {
+        std::ostringstream trace;
+        Profiler::instance().exportChromeTrace(trace);
+        assert(trace.str().find("\"traceEvents\"") != std::string::npos);
+    }
+
+    stop = true;
+    writer.join();
+
+    assert(Profiler::instance().summary(ProfilePhase::CLASSIFY).count > 0);
+}
+
+void classifyOnce() {
+    triangle().relationWithPlane(Plane(Point3D(0, 0, 1), Vector3D(0, 0, 1)));
+}
+
+void testShortLivedThreadsAreCapped() {
+    for (int i = 0; i < 200; ++i) {
+        std::thread thread(classifyOnce);
+        thread.join();
+    }
+    assert(Profiler::instance().getBufferCount() <= 8);
+}
+
+void testExportedBuffersAreRecycled() {
+    std::ostringstream trace;
+    Profiler::instance().exportChromeTrace(trace);
+    size_t buffers = Profiler::instance().getBufferCount();
+
+    for (int i = 0; i < 50; ++i) {
+        std::thread thread(classifyOnce);
+        thread.join();
+
+        std::ostringstream next;
+        Profiler::instance().exportChromeTrace(next);
+        assert(next.str().find("\"classify\"") != std::string::npos);
+    }
+    assert(Profiler::instance().getBufferCount() == buffers);
+}
+
+// A bucket's upper bound overshoots every duration in it by less than 12.5%
+void testBucketBounds() {
+    for (uint64_t ticks = 0; ticks < 100000; ++ticks) {
+        size_t bucket = ProfileBuffer::bucket(ticks);
+        uint64_t upper = ProfileBuffer::bucketUpperBound(bucket);
+
+        assert(bucket < ProfileBuffer::BUCKETS);
+        assert(ticks <= upper && upper <= ticks + ticks / 8);
+        assert(ProfileBuffer::bucket(upper) == bucket);
+    }
+    assert(ProfileBuffer::bucket(UINT64_MAX) == ProfileBuffer::BUCKETS - 1);
+}
+
+void testQuantiles() {
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<double> exponent(1, 7);
+
+    std::vector<uint64_t> durations;
+    ProfileBuffer buffer(0);
+    for (int i = 0; i < 20000; ++i) {
+        uint64_t duration = static_cast<uint64_t>(std::pow(10.0, exponent(rng)));
+        durations.push_back(duration);
+        buffer.record(ProfilePhase::SPLIT, 1000, 1000 + duration);
+    }
+    std::sort(durations.begin(), durations.end());
+
+    std::vector<uint64_t> counts(ProfileBuffer::BUCKETS, 0);
+    buffer.mergeHistogram(ProfilePhase::SPLIT, counts);
+    PhaseSummary summary = Profiler::summarize(counts, 1);
+    assert(summary.count == durations.size());
+
+    auto within = [&](double quantile, double q) {
+        double exact = static_cast<double>(durations[static_cast<size_t>(q * (durations.size() - 1))]);
+        return exact <= quantile && quantile <= exact * 1.125;
+    };
+    assert(within(summary.p50, 0.5));
+    assert(within(summary.p99, 0.99));
+    assert(within(summary.p999, 0.999));
+}
+
+// Every classify, split and allocate scope of an insertion lies within its insert scope
+void testInsertNesting() {
+    std::string trace;
+    uint32_t threadId = 0;
+
+    std::thread thread([&]() {
+        BSPTree tree;
+        tree.insert(Polygon({Point3D(-1, 0, -1), Point3D(-1, 0, 1), Point3D(1, 0, 1), Point3D(1, 0, -1)}));
+        tree.insert(Polygon({Point3D(0, -1, -1), Point3D(0, 1, -1), Point3D(0, 1, 1), Point3D(0, -1, 1)}));
+
+        ProfileBuffer* buffer = Profiler::instance().threadBuffer();
+        assert(buffer != nullptr);
+        threadId = buffer->getThreadId();
+
+        std::ostringstream os;
+        Profiler::instance().exportChromeTrace(os);
+        trace = os.str();
+    });
+    thread.join();
+
+    struct Span {
+        std::string name;
+        double start;
+        double end;
+    };
+    std::vector<Span> inserts;
+    std::vector<Span> nested;
+
+    std::istringstream lines(trace);
+    for (std::string line; std::getline(lines, line);) {
+        char name[32];
+        double ts, dur;
+        unsigned tid;
+        if (std::sscanf(line.c_str(), "{\"name\":\"%31[^\"]\",\"cat\":\"bsp\",\"ph\":\"X\",\"ts\":%lf,\"dur\":%lf,\"pid\":0,\"tid\":%u}",
+                        name, &ts, &dur, &tid) != 4 || tid != threadId) {
+            continue;
+        }
+        (std::string(name) == "insert" ? inserts : nested).push_back({name, ts, ts + dur});
+    }
+
+    assert(inserts.size() == 2);
+    bool split = false;
+    for (const auto& span : nested) {
+        split = split || span.name == "split";
+
+        // Timestamps are rounded to the nanosecond on export
+        bool inside = std::any_of(inserts.begin(), inserts.end(), [&](const Span& insert) {
+            return insert.start <= span.start + 0.002 && span.end <= insert.end + 0.002;
+        });
+        assert(inside);
+    }
+    assert(split);
+}
+
+int main() {
+    testExportWhileRecording();
+    testShortLivedThreadsAreCapped();
+    testExportedBuffersAreRecycled();
+    testBucketBounds();
+    testQuantiles();
+    testInsertNesting();
+
+    std::cout << "profiler_test passed" << std::endl;
+    return 0;
+}
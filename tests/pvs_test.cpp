@@ -0,0 +1,173 @@
+#include "../pvs.hpp"
+#include <cassert>
+#include <random>
+#include <sstream>
+
+// Wall in the plane x = x0 spanning [0, height] in y and [0, 4] in z, facing +x
+Polygon wall(float x0, float height) {
+    return Polygon({Point3D(x0, height, 0), Point3D(x0, height, 4), Point3D(x0, 0, 4), Point3D(x0, 0, 0)});
+}
+
+// Box spanning z in [0, 4]; faces point outwards for a solid block, inwards for a room
+std::vector<Polygon> box(float x0, float x1, float y0, float y1, bool room) {
+    auto corner = [&](int x, int y, int z) {
+        return Point3D(x ? x1 : x0, y ? y1 : y0, z ? 4 : 0);
+    };
+    std::vector<Polygon> faces = {
+        Polygon({corner(0, 0, 0), corner(0, 0, 1), corner(0, 1, 1), corner(0, 1, 0)}),
+        Polygon({corner(1, 0, 0), corner(1, 1, 0), corner(1, 1, 1), corner(1, 0, 1)}),
+        Polygon({corner(0, 0, 0), corner(1, 0, 0), corner(1, 0, 1), corner(0, 0, 1)}),
+        Polygon({corner(0, 1, 0), corner(0, 1, 1), corner(1, 1, 1), corner(1, 1, 0)}),
+        Polygon({corner(0, 0, 0), corner(0, 1, 0), corner(1, 1, 0), corner(1, 0, 0)}),
+        Polygon({corner(0, 0, 1), corner(1, 0, 1), corner(1, 1, 1), corner(0, 1, 1)}),
+    };
+    if (room) {
+        for (auto& face : faces) {
+            face.flip();
+        }
+    }
+    return faces;
+}
+
+// Four rooms in a row, joined by doorways alternating between y = 8..10 and y = 0..2
+BSPTree staggeredRooms() {
+    BSPTree tree;
+    tree.insert(box(0, 43, 0, 10, true));
+    tree.insert(box(10, 11, 0, 8, false));
+    tree.insert(box(21, 22, 2, 10, false));
+    tree.insert(box(32, 33, 0, 8, false));
+    return tree;
+}
+
+void testDoorway() {
+    BSPTree tree;
+    tree.insert(wall(0, 8));
+    tree.insert(wall(-5, 10));
+
+    PVS pvs;
+    pvs.build(tree, 2);
+
+    assert(pvs.getLeafCount() == 2);
+    assert(!pvs.getPortals().empty());
+
+    // The sight line at y = 9 passes above the wall at x = 0
+    assert(pvs.isVisible(Point3D(1, 9, 2), Point3D(-2, 9, 2)));
+    assert(pvs.isVisible(Point3D(-2, 9, 2), Point3D(1, 9, 2)));
+}
+
+void testWallCutOutOfPortal() {
+    BSPTree tree;
+    tree.insert(wall(0, 8));
+    tree.insert(wall(-5, 10));
+
+    PVS pvs;
+    pvs.build(tree, 2);
+
+    // Every remaining piece lies outside the wall
+    for (const auto& portal : pvs.getPortals()) {
+        Point3D center = portal.polygon.centroid();
+        bool insideWall = center.getY() > NType(0) && center.getY() < NType(8) &&
+                          center.getZ() > NType(0) && center.getZ() < NType(4);
+        assert(!insideWall);
+    }
+}
+
+void testSerialization() {
+    BSPTree tree;
+    tree.insert(wall(0, 8));
+    tree.insert(wall(-5, 10));
+
+    PVS pvs;
+    pvs.build(tree, 2);
+
+    std::stringstream stream;
+    pvs.serialize(stream);
+
+    PVS loaded;
+    loaded.deserialize(stream, tree);
+    for (size_t from = 0; from < pvs.getLeafCount(); ++from) {
+        for (size_t to = 0; to < pvs.getLeafCount(); ++to) {
+            assert(loaded.isVisible(from, to) == pvs.isVisible(from, to));
+        }
+    }
+}
+
+void testCorruptRows() {
+    BSPTree tree;
+    tree.insert(wall(0, 8));
+    tree.insert(wall(-5, 10));
+
+    auto load = [&](const std::vector<uint8_t>& row, uint32_t size) {
+        std::stringstream stream;
+        uint32_t leafCount = 2;
+        stream.write("PVS1", 4);
+        stream.write(reinterpret_cast<const char*>(&leafCount), sizeof(leafCount));
+        for (int i = 0; i < 2; ++i) {
+            stream.write(reinterpret_cast<const char*>(&size), sizeof(size));
+            stream.write(reinterpret_cast<const char*>(row.data()), row.size());
+        }
+
+        PVS pvs;
+        try {
+            pvs.deserialize(stream, tree);
+        } catch (const std::runtime_error&) {
+            return false;
+        }
+        return true;
+    };
+
+    assert(load({3}, 1));
+    assert(load({0, 1}, 2));
+    assert(!load({0}, 1));           // Zero run without a length
+    assert(!load({0, 0}, 2));        // Empty zero run
+    assert(!load({0, 2}, 2));        // Decodes past the row
+    assert(!load({3, 3}, 2));        // Decodes past the row
+    assert(!load({}, 0xFFFFFFFF));   // Size far beyond any valid row
+}
+
+// Every portal of the chain from the first room to the last passes the
+// front/back tests, but no straight line passes through all three doorways
+void testChainCulling() {
+    BSPTree tree = staggeredRooms();
+
+    PVS pvs;
+    pvs.build(tree, 2);
+
+    Point3D first(5, 5, 2), second(16, 5, 2), third(27, 5, 2), fourth(38, 5, 2);
+    assert(pvs.isVisible(first, second));
+    assert(pvs.isVisible(first, third));
+    assert(pvs.isVisible(second, fourth));
+    assert(!pvs.isVisible(first, fourth));
+    assert(!pvs.isVisible(fourth, first));
+}
+
+// Any unobstructed sight line must be reported visible
+void testConservative() {
+    BSPTree tree = staggeredRooms();
+
+    PVS pvs;
+    pvs.build(tree, 2);
+
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> x(0.1f, 42.9f), y(0.1f, 9.9f), z(0.1f, 3.9f);
+    for (int i = 0; i < 5000; ++i) {
+        Point3D eye(x(rng), y(rng), z(rng));
+        Point3D target(x(rng), y(rng), z(rng));
+
+        if (tree.detectCollision(LineSegment(eye, target)) == nullptr) {
+            assert(pvs.isVisible(eye, target));
+        }
+    }
+}
+
+int main() {
+    testDoorway();
+    testChainCulling();
+    testConservative();
+    testWallCutOutOfPortal();
+    testSerialization();
+    testCorruptRows();
+
+    std::cout << "pvs_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include "../bsp_tree.hpp"
+#include <cassert>
+#include <random>
+
+// Nearly parallel to z = 0 and crossing it along two long edges
+Polygon shallowTriangle() {
+    return Polygon({Point3D(-1000, 0, -0.05), Point3D(1000, 0, 0.05), Point3D(0, 1000, 0.05)});
+}
+
+void testShallowSplit() {
+    Plane plane(Point3D(0, 0, 0), Vector3D(0, 0, 1));
+    auto [front, back] = shallowTriangle().split(plane);
+
+    assert(front.getVertices().size() == 4);
+    assert(back.getVertices().size() == 3);
+    for (const auto& vertex : front.getVertices()) {
+        assert(plane.dist2Point(vertex) >= NType(0));
+    }
+    for (const auto& vertex : back.getVertices()) {
+        assert(plane.dist2Point(vertex) <= NType(0));
+    }
+}
+
+void testShallowInsert() {
+    BSPTree tree;
+    tree.insert(Polygon({Point3D(-2000, -2000, 0), Point3D(2000, -2000, 0), Point3D(2000, 2000, 0)}));
+    tree.insert(shallowTriangle());
+
+    assert(tree.getPolygons().size() == 3);
+}
+
+// Small triangles scattered at random produce many near-vertex splits
+void testRandomTriangles() {
+    for (unsigned seed = 0; seed < 30; ++seed) {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> position(-10, 10);
+        std::uniform_real_distribution<float> offset(-1, 1);
+
+        BSPTree tree;
+        for (int i = 0; i < 100; ++i) {
+            Point3D a(position(rng), position(rng), position(rng));
+            Point3D b = a + Point3D(offset(rng), offset(rng), offset(rng));
+            Point3D c = a + Point3D(offset(rng), offset(rng), offset(rng));
+            tree.insert(Polygon({a, b, c}));
+        }
+
+        for (const auto& polygon : tree.getPolygons()) {
+            assert(!polygon.isDegenerate());
+        }
+    }
+}
+
+void testDegenerateInsert() {
+    BSPTree tree;
+    tree.insert(Polygon({Point3D(0, 0, 0), Point3D(1, 0, 0), Point3D(2, 0, 0)}));
+    tree.insert(Polygon({Point3D(0, 0, 0), Point3D(1, 0, 0)}));
+
+    assert(tree.getRoot() == nullptr);
+}
+
+int main() {
+    testShallowSplit();
+    testShallowInsert();
+    testRandomTriangles();
+    testDegenerateInsert();
+
+    std::cout << "split_test passed" << std::endl;
+    return 0;
+}